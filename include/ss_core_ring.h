@@ -0,0 +1,103 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef __SS_CORE_RING_H__
+#define __SS_CORE_RING_H__
+
+/*
+ * Bounded lock-free ring carrying core commands from any thread to the
+ * main loop: many producers, one consumer. Each slot has a sequence
+ * number telling whose turn it is, so a producer claims a slot with one
+ * compare-and-swap on head and the consumer needs no atomics at all.
+ * Shared with sys_ringbench, which measures it against a plain pipe.
+ */
+#define CORE_RING_SIZE		256	/* power of two */
+
+struct _internal_msg {
+	int type;
+	int pid;
+	int status;
+	double stamp;		/* ecore_time_get() when posted */
+};
+
+struct core_ring_slot {
+	volatile unsigned int seq;
+	struct _internal_msg msg;
+};
+
+struct core_ring {
+	struct core_ring_slot slot[CORE_RING_SIZE];
+	volatile unsigned int head;	/* producers */
+	unsigned int tail;		/* consumer only */
+};
+
+static inline void core_ring_init(struct core_ring *ring)
+{
+	unsigned int i;
+
+	for (i = 0; i < CORE_RING_SIZE; i++)
+		ring->slot[i].seq = i;
+	ring->head = 0;
+	ring->tail = 0;
+}
+
+/* any thread; -1 when the ring is full */
+static inline int core_ring_push(struct core_ring *ring,
+				 const struct _internal_msg *msg)
+{
+	struct core_ring_slot *slot;
+	unsigned int pos;
+	int diff;
+
+	pos = ring->head;
+	for (;;) {
+		slot = &ring->slot[pos & (CORE_RING_SIZE - 1)];
+		diff = (int)(slot->seq - pos);
+		if (diff == 0) {
+			if (__sync_bool_compare_and_swap(&ring->head, pos,
+							 pos + 1))
+				break;
+			pos = ring->head;
+		} else if (diff < 0)
+			return -1;
+		else
+			pos = ring->head;
+	}
+
+	slot->msg = *msg;
+	__sync_synchronize();
+	slot->seq = pos + 1;
+	return 0;
+}
+
+/* consumer only; 0 when the ring is empty */
+static inline int core_ring_pop(struct core_ring *ring,
+				struct _internal_msg *msg)
+{
+	struct core_ring_slot *slot;
+
+	slot = &ring->slot[ring->tail & (CORE_RING_SIZE - 1)];
+	if (slot->seq != ring->tail + 1)
+		return 0;
+
+	*msg = slot->msg;
+	__sync_synchronize();
+	slot->seq = ring->tail + CORE_RING_SIZE;
+	ring->tail++;
+	return 1;
+}
+
+#endif /* __SS_CORE_RING_H__ */
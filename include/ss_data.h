@@ -36,6 +36,7 @@ enum {
 
 #define VCONFKEY_INTERNAL_ADDED_USB_STORAGE 	"memory/private/sysman/added_storage_uevent"
 #define VCONFKEY_INTERNAL_REMOVED_USB_STORAGE	"memory/private/sysman/removed_storage_uevent"
+#define VCONFKEY_INTERNAL_SYSNOTI_TRACE		"memory/private/sysman/sysnoti_trace"
 
 #define PREDEF_CALL			"call"
 #define PREDEF_LOWMEM			"lowmem"
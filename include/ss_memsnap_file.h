@@ -0,0 +1,71 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef __SS_MEMSNAP_FILE_H__
+#define __SS_MEMSNAP_FILE_H__
+
+#include <stdint.h>
+
+/*
+ * Memory snapshots taken on low memory events, kept in a ring file:
+ *   memsnap_file_hdr, then MEMSNAP_SLOTS slots of MEMSNAP_SLOT_SIZE
+ *   bytes, each a memsnap_hdr followed by count memsnap_proc.
+ * next is the slot the following snapshot goes to, seq counts all
+ * snapshots ever written, so the oldest slot is the one after next.
+ * A slot whose seq is 0 was never written.
+ */
+#define MEMSNAP_FILE		"/var/log/memps.snap"
+#define MEMSNAP_MAGIC		0x504e534d	/* "MSNP" */
+#define MEMSNAP_VERSION		2
+#define MEMSNAP_SLOTS		8
+#define MEMSNAP_MAX_PROCS	256
+#define MEMSNAP_NAME_LEN	16
+#define MEMSNAP_REASON_LEN	32
+
+struct memsnap_file_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slots;
+	uint32_t slot_size;
+	uint32_t next;
+	uint32_t seq;
+};
+
+struct memsnap_hdr {
+	uint32_t seq;
+	uint32_t count;
+	int64_t time;		/* seconds since the epoch */
+	int32_t victim_pid;
+	uint32_t mem_total_kb;
+	uint32_t mem_avail_kb;
+	uint32_t duration_us;	/* time taken by the snapshot */
+	uint32_t skipped;	/* processes left out past MEMSNAP_MAX_PROCS */
+	char reason[MEMSNAP_REASON_LEN];
+};
+
+struct memsnap_proc {
+	int32_t pid;
+	int32_t oom_score_adj;
+	uint32_t rss_kb;
+	uint32_t pss_kb;	/* 0 without smaps_rollup */
+	uint32_t swap_kb;
+	char name[MEMSNAP_NAME_LEN];
+};
+
+#define MEMSNAP_SLOT_SIZE	(sizeof(struct memsnap_hdr) + \
+				 MEMSNAP_MAX_PROCS * sizeof(struct memsnap_proc))
+
+#endif /* __SS_MEMSNAP_FILE_H__ */
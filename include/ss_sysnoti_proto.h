@@ -0,0 +1,126 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef __SS_SYSNOTI_PROTO_H__
+#define __SS_SYSNOTI_PROTO_H__
+
+#include <stdint.h>
+
+/*
+ * Legacy stream protocol on SYSNOTI_SOCKET_PATH (used by libsysman):
+ *   int pid, int cmd, str type, str path, int argc, str argv[argc]
+ * where str is an int length followed by the bytes. Reply is one int.
+ *
+ * v2 protocol on SYSNOTI_V2_SOCKET_PATH (SOCK_SEQPACKET): every request
+ * is a single datagram made of a sysnoti_v2_hdr, nrec sysnoti_v2_rec
+ * and a blob of NUL-terminated strings the records point into. The
+ * reply is one datagram of nrec ints. A frame carrying an unknown
+ * version is answered with -EPROTONOSUPPORT so that the client can fall
+ * back to the legacy socket, any other malformed frame with a single
+ * negative errno.
+ *
+ * Only CALL_SYSMAN_ACTION_BATCH frames may carry more than one record:
+ * the actions are queued in record order and dispatched together, and
+ * the reply holds the result of each record.
+ *
+ * CALL_SYSMAN_ACTION_WAIT is answered like CALL_SYSMAN_ACTION, and once
+ * the action has finished a struct sysnoti_done follows on the same
+ * connection (a one-shot legacy connection stays open until then).
+ *
+ * QUERY_SYSMAN_STATS is v2 only. A record with no type asks for every
+ * action, otherwise only the named one. The reply is one datagram
+ * holding an int32 count followed by count struct sysnoti_action_stats;
+ * a negative count is an errno and carries no records.
+ *
+ * QUERY_SYSMAN_BG_LRU is v2 only and takes a record with no arguments.
+ * The reply is one datagram holding an int32 count followed by count
+ * struct sysnoti_bg_app, in the order the apps would be demoted.
+ */
+
+#define SYSNOTI_SOCKET_PATH		"/tmp/sn"
+#define SYSNOTI_V2_SOCKET_PATH		"/tmp/sn2"
+
+enum sysnoti_cmd {
+	ADD_SYSMAN_ACTION,
+	CALL_SYSMAN_ACTION,
+	OPEN_SYSMAN_SESSION,
+	CALL_SYSMAN_ACTION_BATCH,
+	CALL_SYSMAN_ACTION_WAIT,
+	QUERY_SYSMAN_STATS,
+	QUERY_SYSMAN_BG_LRU
+};
+
+#define SYSNOTI_V2_MAGIC		0x32764e53	/* "SNv2" */
+#define SYSNOTI_V2_VERSION		2
+#define SYSNOTI_V2_MAX_FRAME		4096
+#define SYSNOTI_V2_MAXARG		16
+#define SYSNOTI_V2_MAX_BATCH		32
+/* string offset of an absent (NULL) string */
+#define SYSNOTI_V2_NO_STR		0xffff
+
+struct sysnoti_v2_hdr {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t cmd;
+	int32_t pid;
+	uint16_t nrec;
+	uint16_t blob_len;
+};
+
+struct sysnoti_v2_rec {
+	uint16_t type_off;
+	uint16_t path_off;
+	uint16_t argc;
+	uint16_t argv_off[SYSNOTI_V2_MAXARG];
+};
+
+#define SYSNOTI_DONE_MAGIC		0x454e4f44	/* "DONE" */
+
+struct sysnoti_done {
+	int32_t magic;
+	int32_t seq;		/* request number on the connection, from 1 */
+	int32_t pid;		/* forked child, 0 if the action ran in-process */
+	int32_t status;		/* child wait status or action return value */
+};
+
+/* bucket i counts [2^i, 2^(i+1)) usec, the last bucket is open-ended */
+#define SYSNOTI_HIST_BUCKETS		24
+#define SYSNOTI_STATS_TYPE_LEN		32
+
+enum sysnoti_hist {
+	SYSNOTI_HIST_WAIT,	/* queue insert to dispatch */
+	SYSNOTI_HIST_RUN,	/* predefine action call */
+	SYSNOTI_HIST_CHILD,	/* dispatch to forked child retirement */
+	SYSNOTI_HIST_MAX
+};
+
+struct sysnoti_action_stats {
+	char type[SYSNOTI_STATS_TYPE_LEN];
+	uint32_t calls;
+	uint32_t timeouts;	/* forked children stopped by the watchdog */
+	uint32_t hist[SYSNOTI_HIST_MAX][SYSNOTI_HIST_BUCKETS];
+};
+
+#define SYSNOTI_BG_LRU_MAX		128
+
+struct sysnoti_bg_app {
+	int32_t pid;
+	int32_t oomadj;
+	uint32_t idle_ms;	/* time since it went background */
+	uint32_t rss_kb;
+};
+
+#endif /* __SS_SYSNOTI_PROTO_H__ */
@@ -65,6 +65,7 @@ vconftool set -t int memory/sysman/mmc_format -1 -i
 
 vconftool set -t string memory/private/sysman/added_storage_uevent "" -i
 vconftool set -t string memory/private/sysman/removed_storage_uevent "" -u 5000 -i
+vconftool set -t int memory/private/sysman/sysnoti_trace 0 -i
 
 
 heynotitool set power_off_start
@@ -101,6 +102,12 @@ fi
 %{_bindir}/restart
 %{_bindir}/movi_format.sh
 %{_bindir}/sys_event
+%{_bindir}/sys_stats
+%{_bindir}/sys_memsnap
+%{_bindir}/sys_drip
+%{_bindir}/sys_ringbench
+%{_bindir}/sys_oombench
+%{_bindir}/sys_pluginbench
 %{_bindir}/sys_device_noti
 %{_datadir}/system-server/sys_device_noti/batt_full_icon.png
 %{_datadir}/system-server/udev-rules/91-system-server.rules
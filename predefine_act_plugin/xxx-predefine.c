@@ -16,14 +16,38 @@
 
 
 #include <stdio.h>
+#include <unistd.h>
+#include <string.h>
 #include <sysman.h>
 
+/*
+ * A child whose pid is returned is watched by system_server and gets
+ * SIGTERM, then SIGKILL, once it runs longer than this many seconds.
+ * Calling this action with "hang" exercises that path, the timeout then
+ * shows up in sys_stats.
+ */
+int ss_action_timeout = 5;
+
+/* nothing here is shared with system_server, so it may run on a worker */
+int ss_thread_safe;
+
 int SS_PREDEFINE_ACT_FUNC(int argc, char **argv)
 {
 	int i;
+	pid_t pid;
+
 	printf("kqwekrqkwerqwer\n");
 	for (i = 0; i < argc; i++)
 		printf("%s\n", argv[i]);
+
+	if (argc > 0 && !strcmp(argv[0], "hang")) {
+		pid = fork();
+		if (pid == 0) {
+			for (;;)
+				pause();
+		}
+		return pid;
+	}
 	return 0;
 }
 
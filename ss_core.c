@@ -15,58 +15,167 @@
 */
 
 
+#include <stdint.h>
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
 #include <sysman.h>
 #include "include/ss_data.h"
+#include "include/ss_core_ring.h"
 #include "ss_queue.h"
 #include "ss_log.h"
 #include "ss_predefine.h"
 #include "ss_core.h"
+#include "ss_watchdog.h"
 
 enum ss_core_cmd_type {
 	SS_CORE_ACT_RUN,
 	SS_CORE_ACT_CLEAR
 };
 
-struct _internal_msg {
-	int type;
-	int pid;
-};
+/*
+ * Commands are posted to a bounded lock-free ring, so they can come from
+ * any thread, and the main loop is woken through an eventfd. Every
+ * wakeup drains the whole ring, and all RUN commands in it share one
+ * dispatch pass over the run queue.
+ */
+static struct core_ring core_ring;
+static volatile int core_ring_overflow;
+static int core_efd = -1;
+static struct ss_core_stats core_stats;
 
-static int core_pipe[2];
+#define CORE_WORKERS		2
+#define CORE_STALL_WARN		0.1	/* seconds */
 
-static int _ss_core_action_run(void *user_data,
-			       struct ss_run_queue_entry *rq_entry)
+static int lane_busy[SS_LANE_MAX];
+
+/*
+ * Actions may return the pid of a program that was already running.
+ * Only a child of ours is reaped by the signalfd reaper, so only then
+ * does the entry wait for its exit and may the watchdog signal it.
+ */
+static int core_is_child(int pid)
 {
-	struct ss_action_entry *act_entry = rq_entry->action_entry;
-	int ret;
-	char tmp[128];
+	siginfo_t info;
 
-	rq_entry->state = SS_STATE_RUNNING;
-	ret = act_entry->predefine_action(rq_entry->argc, rq_entry->argv);
+	if (pid <= 1)
+		return 0;
+	info.si_pid = 0;
+	return waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0;
+}
+
+static void ss_core_action_done(struct ss_run_queue_entry *rq_entry, int ret)
+{
 	if (ret <= 0) {
 		if (ret < 0)
 			PRT_TRACE_ERR("[SYSMAN] predefine action failed");
 		goto fast_done;
-	} else {
-		snprintf(tmp, sizeof(tmp), "/proc/%d/status", ret);
-		if (access(tmp, R_OK) == 0)
-			rq_entry->forked_pid = ret;
-		else
-			goto fast_done;
-	}
-	return 0;
+	} else if (core_is_child(ret)) {
+		ss_run_queue_set_pid(rq_entry, ret);
+		ss_watchdog_arm(rq_entry, rq_entry->action_entry->timeout);
+	} else
+		goto fast_done;
+	return;
 
  fast_done:
-	rq_entry->forked_pid = -1;
-	rq_entry->state = SS_STATE_DONE;
-	ss_core_action_clear(-1);
+	ss_run_queue_set_pid(rq_entry, -1);
+	rq_entry->status = ret;
+	ss_run_queue_set_state(rq_entry, SS_STATE_DONE);
+	ss_core_action_clear(-1, 0);
+}
+
+/* runs on a worker thread, the entry is not touched by the main loop */
+static void core_worker_run(void *data, Ecore_Thread *thread)
+{
+	struct ss_run_queue_entry *rq_entry = data;
+
+	rq_entry->status =
+	    rq_entry->action_entry->predefine_action(rq_entry->argc,
+						     rq_entry->argv);
+	rq_entry->ran = ecore_time_get() - rq_entry->started;
+}
+
+static void core_worker_end(void *data, Ecore_Thread *thread)
+{
+	struct ss_run_queue_entry *rq_entry = data;
+
+	lane_busy[rq_entry->action_entry->lane] = 0;
+	core_stats.worker_done++;
+	ss_action_entry_account(rq_entry->action_entry, SYSNOTI_HIST_RUN,
+				rq_entry->ran);
+	ss_core_action_done(rq_entry, rq_entry->status);
+	/* start whatever queued up behind it on the lane */
+	ss_core_action_run();
+}
+
+static int _ss_core_action_run(void *user_data,
+			       struct ss_run_queue_entry *rq_entry)
+{
+	struct ss_action_entry *act_entry = rq_entry->action_entry;
+	double start, stall;
+	int ret;
+
+	if (act_entry->lane != SS_LANE_MAIN && lane_busy[act_entry->lane])
+		return 1;
+
+	start = ecore_time_get();
+	rq_entry->started = start;
+	ss_action_entry_account(act_entry, SYSNOTI_HIST_WAIT,
+				start - rq_entry->added);
+
+	if (act_entry->lane != SS_LANE_MAIN) {
+		lane_busy[act_entry->lane] = 1;
+		core_stats.worker_started++;
+		ss_run_queue_set_state(rq_entry, SS_STATE_RUNNING);
+		ecore_thread_run(core_worker_run, core_worker_end,
+				 core_worker_end, rq_entry);
+		return 0;
+	}
+
+	ss_run_queue_set_state(rq_entry, SS_STATE_RUNNING);
+	ret = act_entry->predefine_action(rq_entry->argc, rq_entry->argv);
+
+	stall = ecore_time_get() - start;
+	ss_action_entry_account(act_entry, SYSNOTI_HIST_RUN, stall);
+	core_stats.stall_total += stall;
+	if (stall > core_stats.stall_max)
+		core_stats.stall_max = stall;
+	if (stall > CORE_STALL_WARN)
+		PRT_TRACE_ERR("[SYSMAN] %s held the main loop for %.3fs",
+			      act_entry->type, stall);
+
+	ss_core_action_done(rq_entry, ret);
 	return 0;
 }
 
-static int core_pipe_cb(void *userdata, Ecore_Fd_Handler * fd_handler)
+static int core_ring_post(int type, int pid, int status)
+{
+	struct _internal_msg msg;
+	uint64_t one = 1;
+	int ret = 0;
+
+	msg.type = type;
+	msg.pid = pid;
+	msg.status = status;
+	msg.stamp = ecore_time_get();
+	if (core_ring_push(&core_ring, &msg) < 0) {
+		/* full, make the next drain rescan both queues */
+		__sync_fetch_and_or(&core_ring_overflow, 1);
+		ret = -1;
+	}
+
+	if (write(core_efd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+		PRT_TRACE_ERR("eventfd write failed: %s", strerror(errno));
+	return ret;
+}
+
+static int core_efd_cb(void *userdata, Ecore_Fd_Handler * fd_handler)
 {
 	struct ss_main_data *ad = (struct ss_main_data *)userdata;
 	struct _internal_msg p_msg;
+	uint64_t cnt;
+	double now, oldest = 0;
+	int run = 0, clear = 0, n = 0;
 
 	if (!ecore_main_fd_handler_active_get(fd_handler, ECORE_FD_READ)) {
 		PRT_TRACE_ERR
@@ -74,49 +183,82 @@ static int core_pipe_cb(void *userdata, Ecore_Fd_Handler * fd_handler)
 		return 1;
 	}
 
-	read(core_pipe[0], &p_msg, sizeof(struct _internal_msg));
+	read(core_efd, &cnt, sizeof(cnt));
+	core_stats.wakeups++;
+
+	while (core_ring_pop(&core_ring, &p_msg)) {
+		if (n++ == 0)
+			oldest = p_msg.stamp;
+		switch (p_msg.type) {
+		case SS_CORE_ACT_RUN:
+			run++;
+			break;
+		case SS_CORE_ACT_CLEAR:
+			if (p_msg.pid > 0)
+				ss_run_queue_retire(p_msg.pid, p_msg.status,
+						    NULL);
+			else
+				clear = 1;
+			break;
+		}
+	}
 
-	switch (p_msg.type) {
-	case SS_CORE_ACT_RUN:
-		ss_run_queue_run(SS_STATE_INIT, _ss_core_action_run, ad);
-		break;
-	case SS_CORE_ACT_CLEAR:
-		ss_run_queue_del_bypid(p_msg.pid);
-		break;
+	if (__sync_lock_test_and_set(&core_ring_overflow, 0)) {
+		run++;
+		clear = 1;
+	}
+
+	if (run) {
+		/* out of budget, let the loop take new requests first */
+		if (ss_run_queue_run(SS_STATE_INIT, _ss_core_action_run, ad))
+			ss_core_action_run();
+		core_stats.dispatches++;
+		core_stats.coalesced += run - 1;
+	}
+	if (clear)
+		ss_run_queue_del_bypid(-1);
+
+	core_stats.msgs += n;
+	if (n > core_stats.max_batch)
+		core_stats.max_batch = n;
+	if (n > 0) {
+		now = ecore_time_get();
+		core_stats.last_latency = now - oldest;
+		core_stats.total_latency += now - oldest;
+		if (core_stats.last_latency > core_stats.max_latency)
+			core_stats.max_latency = core_stats.last_latency;
 	}
 	return 1;
 }
 
 int ss_core_action_run()
 {
-	struct _internal_msg p_msg;
-
-	p_msg.type = SS_CORE_ACT_RUN;
-	p_msg.pid = 0;
-	write(core_pipe[1], &p_msg, sizeof(struct _internal_msg));
-
-	return 0;
+	return core_ring_post(SS_CORE_ACT_RUN, 0, 0);
 }
 
-int ss_core_action_clear(int pid)
+int ss_core_action_clear(int pid, int status)
 {
-	struct _internal_msg p_msg;
-
-	p_msg.type = SS_CORE_ACT_CLEAR;
-	p_msg.pid = pid;
-	write(core_pipe[1], &p_msg, sizeof(struct _internal_msg));
+	return core_ring_post(SS_CORE_ACT_CLEAR, pid, status);
+}
 
-	return 0;
+const struct ss_core_stats *ss_core_stats_get(void)
+{
+	return &core_stats;
 }
 
 int ss_core_init(struct ss_main_data *ad)
 {
-	if (pipe(core_pipe) < 0) {
-		PRT_TRACE_ERR("pipe cannot create");
+	core_ring_init(&core_ring);
+
+	ecore_thread_max_set(CORE_WORKERS);
+
+	core_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (core_efd < 0) {
+		PRT_TRACE_ERR("eventfd cannot create");
 		exit(1);
 	}
 
-	ecore_main_fd_handler_add(core_pipe[0], ECORE_FD_READ,
-				  core_pipe_cb, ad, NULL, NULL);
+	ecore_main_fd_handler_add(core_efd, ECORE_FD_READ,
+				  core_efd_cb, ad, NULL, NULL);
 	return 0;
 }
@@ -20,8 +20,24 @@
 
 #include "include/ss_data.h"
 
+struct ss_core_stats {
+	unsigned int wakeups;		/* eventfd wakeups handled */
+	unsigned int msgs;		/* commands drained */
+	unsigned int dispatches;	/* run queue passes */
+	unsigned int coalesced;		/* RUN commands folded into a pass */
+	unsigned int max_batch;		/* most commands in one wakeup */
+	double last_latency;		/* oldest post to dispatch, seconds */
+	double max_latency;
+	double total_latency;
+	double stall_total;		/* main loop time spent in actions */
+	double stall_max;
+	unsigned int worker_started;	/* actions handed to a worker */
+	unsigned int worker_done;
+};
+
 int ss_core_action_run();
-int ss_core_action_clear(int pid);
+int ss_core_action_clear(int pid, int status);
 int ss_core_init(struct ss_main_data *ad);
+const struct ss_core_stats *ss_core_stats_get(void);
 
 #endif /* __SS_CORE_H__ */
@@ -19,6 +19,7 @@
 
 #include "ss_device_plugin.h"
 #include "ss_log.h"
+#include "ss_proc_event.h"
 #include "include/ss_data.h"
 #include "vconf.h"
 
@@ -40,7 +41,7 @@ struct cpu_freq_entry {
 };
 
 static void __set_freq_limit();
-static int __is_entry_enble(int pid);
+static void __cpu_freq_exit_cb(int pid, enum ss_proc_event event, void *data);
 static int __remove_entry_from_max_cpu_freq_list(int pid);
 static int __remove_entry_from_min_cpu_freq_list(int pid);
 static int __add_entry_to_max_cpu_freq_list(int pid, int freq);
@@ -260,16 +261,20 @@ static void __set_freq_limit()
 	}
 }
 
-static int __is_entry_enable(int pid)
+/* a holder of a limit died without releasing it */
+static void __cpu_freq_exit_cb(int pid, enum ss_proc_event event, void *data)
 {
-	char pid_path[PATH_MAX];
-	
-	snprintf(pid_path, PATH_MAX, "/proc/%d", pid);
-	if (access(pid_path, F_OK) < 0) {
-		return 0;
+	if (data == &max_cpu_freq_list) {
+		__remove_entry_from_max_cpu_freq_list(pid);
+		if (cur_max_cpu_freq == INT_MAX)
+			cur_max_cpu_freq = max_cpu_freq_limit;
+		__write_max_cpu_freq(cur_max_cpu_freq);
+	} else {
+		__remove_entry_from_min_cpu_freq_list(pid);
+		if (cur_min_cpu_freq == INT_MIN)
+			cur_min_cpu_freq = min_cpu_freq_limit;
+		__write_min_cpu_freq(cur_min_cpu_freq);
 	}
-
-	return 1;
 }
 
 static int __remove_entry_from_max_cpu_freq_list(int pid)
@@ -282,7 +287,8 @@ static int __remove_entry_from_max_cpu_freq_list(int pid)
 
 	EINA_LIST_FOREACH_SAFE(max_cpu_freq_list, tmp, tmp_next, entry) {
 		if (entry != NULL) {
-			if ((!__is_entry_enable(entry->pid)) || (entry->pid == pid)) {
+			if (entry->pid == pid) {
+				ss_proc_event_unsubscribe(pid, __cpu_freq_exit_cb, &max_cpu_freq_list);
 				max_cpu_freq_list = eina_list_remove(max_cpu_freq_list, entry);
 				free(entry);
 				continue;
@@ -307,7 +313,8 @@ static int __remove_entry_from_min_cpu_freq_list(int pid)
 
 	EINA_LIST_FOREACH_SAFE(min_cpu_freq_list, tmp, tmp_next, entry) {
 		if (entry != NULL) {
-			if ((!__is_entry_enable(entry->pid)) || (entry->pid == pid)) {
+			if (entry->pid == pid) {
+				ss_proc_event_unsubscribe(pid, __cpu_freq_exit_cb, &min_cpu_freq_list);
 				min_cpu_freq_list = eina_list_remove(min_cpu_freq_list, entry);
 				free(entry);
 				continue;
@@ -333,6 +340,12 @@ static int __add_entry_to_max_cpu_freq_list(int pid, int freq)
 		PRT_TRACE_ERR("Remove duplicated entry failed");
 	}
 
+	r = ss_proc_event_subscribe(pid, SS_PROC_EVENT_EXIT, __cpu_freq_exit_cb, &max_cpu_freq_list);
+	if (r < 0) {
+		PRT_TRACE_ERR("Process %d is gone", pid);
+		return -1;
+	}
+
 	if (freq < cur_max_cpu_freq) {
 		cur_max_cpu_freq = freq;
 	}
@@ -340,6 +353,7 @@ static int __add_entry_to_max_cpu_freq_list(int pid, int freq)
 	entry = malloc(sizeof(struct cpu_freq_entry));
 	if (!entry) {
 		PRT_TRACE_ERR("Malloc failed");
+		ss_proc_event_unsubscribe(pid, __cpu_freq_exit_cb, &max_cpu_freq_list);
 		return -1;
 	}
 	
@@ -365,6 +379,12 @@ static int __add_entry_to_min_cpu_freq_list(int pid, int freq)
 		PRT_TRACE_ERR("Remove duplicated entry failed");
 	}
 
+	r = ss_proc_event_subscribe(pid, SS_PROC_EVENT_EXIT, __cpu_freq_exit_cb, &min_cpu_freq_list);
+	if (r < 0) {
+		PRT_TRACE_ERR("Process %d is gone", pid);
+		return -1;
+	}
+
 	if (freq > cur_min_cpu_freq) {
 		cur_min_cpu_freq = freq;
 	}
@@ -372,6 +392,7 @@ static int __add_entry_to_min_cpu_freq_list(int pid, int freq)
 	entry = malloc(sizeof(struct cpu_freq_entry));
 	if (!entry) {
 		PRT_TRACE_ERR("Malloc failed");
+		ss_proc_event_unsubscribe(pid, __cpu_freq_exit_cb, &min_cpu_freq_list);
 		return -1;
 	}
 	
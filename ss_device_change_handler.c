@@ -71,7 +71,7 @@ static void usb_chgdet_cb(struct ss_main_data *ad)
 	ss_lowbat_is_charge_in_now();
 	/* check current battery level */
 	ss_lowbat_monitor(NULL);
-	ss_action_entry_call_internal(PREDEF_USBCON, 0);
+	ss_action_entry_call_internal_id(SS_ACTION_USBCON, 0);
 
 	if (plugin_intf->OEM_sys_get_jack_usb_online(&val)==0) {
 		if (val==1) {
@@ -127,7 +127,7 @@ static void ta_chgdet_cb(struct ss_main_data *ad)
 static void earjack_chgdet_cb(struct ss_main_data *ad)
 {
 	PRT_TRACE("jack - earjack changed\n");
-	ss_action_entry_call_internal(PREDEF_EARJACKCON, 0);
+	ss_action_entry_call_internal_id(SS_ACTION_EARJACKCON, 0);
 }
 
 static void earkey_chgdet_cb(struct ss_main_data *ad)
@@ -379,7 +379,7 @@ static void charge_cb(struct ss_main_data *ad)
 	if (plugin_intf->OEM_sys_get_battery_health(&val) == 0) {
 		if (val==BATTERY_OVERHEAT || val==BATTERY_COLD) {
 			PRT_TRACE_ERR("Battery health status is not good (%d)", val);
-			ss_action_entry_call_internal(PREDEF_LOWBAT, 1, CHARGE_ERROR_ACT);
+			ss_action_entry_call_internal_id(SS_ACTION_LOWBAT, 1, CHARGE_ERROR_ACT);
 			return;
 		}
 	} else {
@@ -409,12 +409,12 @@ static void __usb_storage_cb(keynode_t *key, void *data)
 	if (data == NULL) {
 		PRT_TRACE("USB Storage removed");
 		vconf_value = vconf_get_str(VCONFKEY_INTERNAL_REMOVED_USB_STORAGE);
-		ss_action_entry_call_internal(PREDEF_USB_STORAGE_REMOVE, 1, vconf_value);
+		ss_action_entry_call_internal_id(SS_ACTION_USB_STORAGE_REMOVE, 1, vconf_value);
 	} else {
 		PRT_TRACE("USB Storage added");
 		show_tickernoti("Mass storage enabled");
 		vconf_value = vconf_get_str(VCONFKEY_INTERNAL_ADDED_USB_STORAGE);
-		ss_action_entry_call_internal(PREDEF_USB_STORAGE_ADD, 1, vconf_value);
+		ss_action_entry_call_internal_id(SS_ACTION_USB_STORAGE_ADD, 1, vconf_value);
 	}
 }
 
@@ -51,6 +51,7 @@ static void prepare_exec(void)
 {
 	int i;
 	int maxfd;
+	sigset_t mask;
 	char buf[MAX_ARGS];
 	FILE *fp;
 
@@ -61,6 +62,10 @@ static void prepare_exec(void)
 	for (i = 0; i < _NSIG; i++)
 		signal(i, SIG_DFL);
 
+	/* SIGCHLD is blocked in system_server for its signalfd */
+	sigemptyset(&mask);
+	sigprocmask(SIG_SETMASK, &mask, NULL);
+
 	/* RESET oomadj value */
 	sprintf(buf,"/proc/%d/oom_adj",getpid());
 	fp = fopen(buf, "w");          
@@ -218,7 +223,7 @@ int ss_launch_if_noexist(const char *execpath, const char *arg, ...)
 		errno = EINVAL;
 		return -1;
 	}
-	if (pid = sysman_get_pid(execpath) > 0)
+	if ((pid = sysman_get_pid(execpath)) > 0)
 		return pid;
 
 	va_start(argptr, arg);
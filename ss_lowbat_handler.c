@@ -94,19 +94,20 @@ static int battery_warning_low_act(void *data)
 	heynoti_get_snoti_name(_SYS_LOW_POWER, lowbat_noti_name, NAME_MAX);
 	ss_noti_send(lowbat_noti_name);
 
-	ss_action_entry_call_internal(PREDEF_LOWBAT, 1, WARNING_LOW_BAT_ACT);
+	ss_action_entry_call_internal_id(SS_ACTION_LOWBAT, 1, WARNING_LOW_BAT_ACT);
 	return 0;
 }
 
 static int battery_critical_low_act(void *data)
 {
-	ss_action_entry_call_internal(PREDEF_LOWBAT, 1, CRITICAL_LOW_BAT_ACT);
+	ss_action_entry_call_internal_id(SS_ACTION_LOWBAT, 1, CRITICAL_LOW_BAT_ACT);
 	return 0;
 }
 
 static int battery_power_off_act(void *data)
 {
-	ss_action_entry_call_internal(PREDEF_LOWBAT, 1,	POWER_OFF_BAT_ACT);
+	ss_action_entry_call_internal_prio(SS_ACTION_LOWBAT, SS_PRIO_CRITICAL,
+					   1, POWER_OFF_BAT_ACT);
 	return 0;
 }
 
@@ -43,6 +43,28 @@
 #define MEM_THRESHOLD_LV1	60
 #define MEM_THRESHOLD_LV2	40
 
+/*
+ * Instead of the OEM memnotify node the state can follow memory stalls
+ * from PSI. A "some" trigger raises LOW and a "full" trigger raises
+ * CRITICAL. Going back to NORMAL is decided from the avg10 values once
+ * they stay under the clear levels. A pressure file given in
+ * SS_PSI_PATH, e.g. a fake one written by a test, has no triggers and
+ * is polled instead.
+ */
+#define LOWMEM_BACKEND_ENV	"SS_LOWMEM_BACKEND"	/* memnotify, psi */
+#define PSI_PATH_ENV		"SS_PSI_PATH"
+#define PSI_MEMORY_PATH		"/proc/pressure/memory"
+
+#define PSI_WINDOW_US		1000000
+#define PSI_SOME_STALL_US	150000	/* some stall per window for LOW */
+#define PSI_FULL_STALL_US	100000	/* full stall per window for CRITICAL */
+
+#define PSI_SOME_AVG		15.0	/* avg10 levels when polling */
+#define PSI_FULL_AVG		10.0
+#define PSI_SOME_CLEAR		5.0	/* both below: back to NORMAL */
+#define PSI_FULL_CLEAR		2.0
+#define PSI_POLL_INTERVAL	1
+
 
 struct lowmem_process_entry {
 	unsigned cur_mem_state;
@@ -53,6 +75,11 @@ struct lowmem_process_entry {
 static int lowmem_fd = -1;
 static int cur_mem_state = MEMNOTIFY_NORMAL;
 
+static int psi_fd = -1;
+static int psi_some_fd = -1;
+static int psi_full_fd = -1;
+static Ecore_Timer *psi_timer;
+
 Ecore_Timer *oom_timer;
 #define OOM_TIMER_INTERVAL	5
 
@@ -65,6 +92,7 @@ static struct lowmem_process_entry lpe[] = {
 	{MEMNOTIFY_NORMAL, MEMNOTIFY_CRITICAL, memory_oom_act},
 	{MEMNOTIFY_LOW, MEMNOTIFY_CRITICAL, memory_oom_act},
 	{MEMNOTIFY_CRITICAL, MEMNOTIFY_CRITICAL, memory_oom_act},
+	{MEMNOTIFY_CRITICAL, MEMNOTIFY_LOW, memory_low_act},
 	{MEMNOTIFY_LOW, MEMNOTIFY_NORMAL, memory_normal_act},
 	{MEMNOTIFY_CRITICAL, MEMNOTIFY_NORMAL, memory_normal_act},
 
@@ -137,7 +165,9 @@ static int memory_low_act(void *data)
 	vconf_set_int(VCONFKEY_SYSMAN_LOW_MEMORY,
 		      VCONFKEY_SYSMAN_LOW_MEMORY_SOFT_WARNING);
 		
-	ss_action_entry_call_internal(PREDEF_LOWMEM, 1, LOW_MEM_ACT);
+	/* only a memps log, must not hold up the kill path */
+	ss_action_entry_call_internal_prio(SS_ACTION_LOWMEM,
+					   SS_PRIO_BACKGROUND, 1, LOW_MEM_ACT);
 
 	return 0;
 }
@@ -162,7 +192,7 @@ static int memory_oom_act(void *data)
 	vconf_set_int(VCONFKEY_SYSMAN_LOW_MEMORY,
 		      VCONFKEY_SYSMAN_LOW_MEMORY_HARD_WARNING);
 
-	ss_action_entry_call_internal(PREDEF_LOWMEM, 1, OOM_MEM_ACT);
+	ss_action_entry_call_internal_id(SS_ACTION_LOWMEM, 1, OOM_MEM_ACT);
 
 	return 1;
 }
@@ -202,6 +232,13 @@ static unsigned int lowmem_read(int fd)
 	return mem_state;
 }
 
+static void lowmem_change(unsigned int mem_state, void *ad)
+{
+	print_lowmem_state(mem_state);
+	lowmem_process(mem_state, ad);
+	cur_mem_state = mem_state;
+}
+
 static int lowmem_cb(void *data, Ecore_Fd_Handler * fd_handler)
 {
 	int fd;
@@ -217,13 +254,143 @@ static int lowmem_cb(void *data, Ecore_Fd_Handler * fd_handler)
 	fd = ecore_main_fd_handler_fd_get(fd_handler);
 
 	mem_state = lowmem_read(fd);
-	print_lowmem_state(mem_state);
-	lowmem_process(mem_state, ad);
-	cur_mem_state = mem_state;
+	lowmem_change(mem_state, ad);
+
+	return 1;
+}
+
+static int psi_read_avg10(double *some, double *full)
+{
+	char buf[256];
+	char *p;
+	int len;
+
+	len = pread(psi_fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0)
+		return -1;
+	buf[len] = '\0';
+
+	*some = *full = 0;
+	p = strstr(buf, "some avg10=");
+	if (p == NULL || sscanf(p, "some avg10=%lf", some) != 1)
+		return -1;
+	/* older kernels have no full line */
+	p = strstr(buf, "full avg10=");
+	if (p != NULL)
+		sscanf(p, "full avg10=%lf", full);
+	return 0;
+}
+
+static Eina_Bool psi_poll_cb(void *data)
+{
+	double some, full;
+	unsigned int mem_state = cur_mem_state;
+	int triggers = (psi_some_fd >= 0);
+
+	if (psi_read_avg10(&some, &full) < 0)
+		return EINA_TRUE;
+
+	/*
+	 * A trigger decides its own level, this only handles the way back
+	 * down. Without a full trigger a "some" stall keeps this running,
+	 * which is what raises CRITICAL then.
+	 */
+	if (psi_full_fd < 0 && full >= PSI_FULL_AVG)
+		mem_state = MEMNOTIFY_CRITICAL;
+	else if (!triggers && some >= PSI_SOME_AVG)
+		mem_state = MEMNOTIFY_LOW;
+	else if (some < PSI_SOME_CLEAR && full < PSI_FULL_CLEAR)
+		mem_state = MEMNOTIFY_NORMAL;
+	else if (cur_mem_state == MEMNOTIFY_CRITICAL && full < PSI_FULL_CLEAR)
+		mem_state = MEMNOTIFY_LOW;
+
+	if (mem_state != cur_mem_state)
+		lowmem_change(mem_state, data);
+
+	if (triggers && cur_mem_state == MEMNOTIFY_NORMAL) {
+		psi_timer = NULL;
+		return EINA_FALSE;
+	}
+	return EINA_TRUE;
+}
+
+static int psi_cb(void *data, Ecore_Fd_Handler *fd_handler)
+{
+	unsigned int mem_state = MEMNOTIFY_LOW;
+
+	if (ecore_main_fd_handler_fd_get(fd_handler) == psi_full_fd)
+		mem_state = MEMNOTIFY_CRITICAL;
+	/* a stall that is not worse than the current state changes nothing */
+	if (mem_state == MEMNOTIFY_LOW && cur_mem_state == MEMNOTIFY_CRITICAL)
+		return 1;
+	if (mem_state != cur_mem_state || mem_state == MEMNOTIFY_CRITICAL)
+		lowmem_change(mem_state, data);
 
+	if (psi_timer == NULL)
+		psi_timer = ecore_timer_add(PSI_POLL_INTERVAL, psi_poll_cb, data);
 	return 1;
 }
 
+static int psi_trigger_open(const char *path, const char *kind, int stall_us,
+			    void *ad)
+{
+	char buf[64];
+	int fd, len;
+
+	fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	len = snprintf(buf, sizeof(buf), "%s %d %d", kind, stall_us,
+		       PSI_WINDOW_US);
+	/* the trigger string includes its terminating NUL */
+	if (write(fd, buf, len + 1) < 0) {
+		PRT_TRACE_ERR("psi %s trigger failed: %s", kind,
+			      strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	/* trigger events are reported as POLLPRI */
+	if (ecore_main_fd_handler_add(fd, ECORE_FD_ERROR, psi_cb, ad, NULL,
+				      NULL) == NULL) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int psi_init(struct ss_main_data *ad)
+{
+	const char *path;
+
+	path = getenv(PSI_PATH_ENV);
+	if (path == NULL)
+		path = PSI_MEMORY_PATH;
+
+	psi_fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (psi_fd < 0) {
+		PRT_TRACE_ERR("%s open failed", path);
+		return -1;
+	}
+
+	if (strcmp(path, PSI_MEMORY_PATH) == 0) {
+		psi_some_fd = psi_trigger_open(path, "some",
+					       PSI_SOME_STALL_US, ad);
+		if (psi_some_fd >= 0)
+			psi_full_fd = psi_trigger_open(path, "full",
+						       PSI_FULL_STALL_US, ad);
+	}
+
+	if (psi_some_fd < 0)
+		psi_timer = ecore_timer_add(PSI_POLL_INTERVAL, psi_poll_cb, ad);
+	else if (psi_full_fd < 0)
+		PRT_TRACE_ERR("psi full trigger failed, polling for critical");
+	PRT_TRACE("lowmem backend : psi (%s, %s)", path,
+		  psi_some_fd >= 0 ? "triggers" : "polling");
+	return 0;
+}
+
 static int set_threshold()
 {
 	if (0 > plugin_intf->OEM_sys_set_memnotify_threshold_lv1(MEM_THRESHOLD_LV1)) {
@@ -239,7 +406,7 @@ static int set_threshold()
 	return 0;
 }
 
-int ss_lowmem_init(struct ss_main_data *ad)
+static int memnotify_init(struct ss_main_data *ad)
 {
 	char lowmem_dev_node[PATH_MAX];
 
@@ -264,3 +431,22 @@ int ss_lowmem_init(struct ss_main_data *ad)
 
 	return 0;
 }
+
+int ss_lowmem_init(struct ss_main_data *ad)
+{
+	const char *backend;
+
+	oom_timer = NULL;
+	backend = getenv(LOWMEM_BACKEND_ENV);
+	if (backend != NULL && strcmp(backend, "psi") == 0)
+		return psi_init(ad);
+
+	if (memnotify_init(ad) == 0)
+		return 0;
+	if (lowmem_fd >= 0 || (backend != NULL &&
+			       strcmp(backend, "memnotify") == 0))
+		return -1;
+
+	/* no memnotify node on this kernel */
+	return psi_init(ad);
+}
@@ -30,6 +30,7 @@
 #include "ss_predefine.h"
 #include "ss_bs.h"
 #include "ss_procmgr.h"
+#include "ss_proc_event.h"
 #include "ss_timemgr.h"
 #include "ss_cpu_handler.h"
 #include "ss_device_plugin.h"
@@ -69,6 +70,7 @@ static void system_server_init(struct ss_main_data *ad)
 	ss_queue_init();
 	ss_core_init(ad);
 	ss_signal_init();
+	ss_proc_event_init();
 	ss_predefine_internal_init();
 	ss_process_manager_init();
 	ss_time_manager_init();
@@ -0,0 +1,231 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include "ss_log.h"
+#include "ss_memsnap.h"
+#include "include/ss_memsnap_file.h"
+
+/*
+ * Replaces forking memps while memory is short. Everything the snapshot
+ * needs is allocated up front: /proc is listed with getdents64 into a
+ * static buffer, each process is read with openat on the /proc fd and
+ * the slot is built in a static buffer and written with one pwrite.
+ */
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+static int snap_fd = -1;
+static struct memsnap_file_hdr snap_file;
+static char snap_slot[MEMSNAP_SLOT_SIZE] __attribute__ ((aligned(8)));
+static char snap_dents[4096] __attribute__ ((aligned(8)));
+static char snap_buf[1024];
+
+static int snap_read(int dirfd, const char *path)
+{
+	int fd, len;
+
+	fd = openat(dirfd, path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	len = read(fd, snap_buf, sizeof(snap_buf) - 1);
+	close(fd);
+	if (len < 0)
+		return -1;
+	snap_buf[len] = '\0';
+	return len;
+}
+
+/* value of a "Key:   123 kB" line, 0 if missing */
+static uint32_t snap_field(const char *key)
+{
+	char *p;
+
+	p = strstr(snap_buf, key);
+	if (p == NULL)
+		return 0;
+	return strtoul(p + strlen(key), NULL, 10);
+}
+
+static int snap_proc(int procfd, const char *pid_name,
+		     struct memsnap_proc *proc)
+{
+	char path[32];
+	char *nl;
+	unsigned long size, rss;
+
+	snprintf(path, sizeof(path), "%s/smaps_rollup", pid_name);
+	if (snap_read(procfd, path) > 0) {
+		proc->rss_kb = snap_field("\nRss:");
+		proc->pss_kb = snap_field("\nPss:");
+		proc->swap_kb = snap_field("\nSwap:");
+	} else {
+		/* kernels before 4.14 */
+		snprintf(path, sizeof(path), "%s/statm", pid_name);
+		if (snap_read(procfd, path) <= 0 ||
+		    sscanf(snap_buf, "%lu %lu", &size, &rss) != 2)
+			return -1;
+		proc->rss_kb = rss * (getpagesize() / 1024);
+		proc->pss_kb = 0;
+		proc->swap_kb = 0;
+	}
+	/* kernel threads */
+	if (proc->rss_kb == 0)
+		return -1;
+
+	proc->pid = atoi(pid_name);
+	snprintf(path, sizeof(path), "%s/oom_score_adj", pid_name);
+	proc->oom_score_adj = snap_read(procfd, path) > 0 ? atoi(snap_buf) : 0;
+
+	snprintf(path, sizeof(path), "%s/comm", pid_name);
+	proc->name[0] = '\0';
+	if (snap_read(procfd, path) > 0) {
+		nl = strchr(snap_buf, '\n');
+		if (nl)
+			*nl = '\0';
+		strncpy(proc->name, snap_buf, MEMSNAP_NAME_LEN - 1);
+		proc->name[MEMSNAP_NAME_LEN - 1] = '\0';
+	}
+	return 0;
+}
+
+static double snap_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int ss_memsnap_write(int victim_pid, const char *reason)
+{
+	struct memsnap_hdr *hdr = (struct memsnap_hdr *)snap_slot;
+	struct memsnap_proc *procs =
+	    (struct memsnap_proc *)(snap_slot + sizeof(struct memsnap_hdr));
+	struct linux_dirent64 *d;
+	double start = snap_now();
+	int procfd, len, pos;
+	ssize_t size;
+
+	if (snap_fd < 0)
+		return -1;
+
+	procfd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (procfd < 0)
+		return -1;
+
+	memset(hdr, 0, sizeof(struct memsnap_hdr));
+	while ((len = syscall(SYS_getdents64, procfd, snap_dents,
+			      sizeof(snap_dents))) > 0) {
+		for (pos = 0; pos < len; pos += d->d_reclen) {
+			d = (struct linux_dirent64 *)(snap_dents + pos);
+			if (d->d_name[0] < '1' || d->d_name[0] > '9')
+				continue;
+			/* a full slot only counts the rest, it reads nothing */
+			if (hdr->count == MEMSNAP_MAX_PROCS)
+				hdr->skipped++;
+			else if (snap_proc(procfd, d->d_name,
+					   &procs[hdr->count]) == 0)
+				hdr->count++;
+		}
+	}
+	close(procfd);
+
+	if (snap_read(AT_FDCWD, "/proc/meminfo") > 0) {
+		hdr->mem_total_kb = snap_field("MemTotal:");
+		hdr->mem_avail_kb = snap_field("MemAvailable:");
+	}
+	hdr->seq = ++snap_file.seq;
+	hdr->time = time(NULL);
+	hdr->victim_pid = victim_pid;
+	strncpy(hdr->reason, reason, MEMSNAP_REASON_LEN - 1);
+	hdr->duration_us = (snap_now() - start) * 1000000;
+
+	size = sizeof(struct memsnap_hdr) +
+	    hdr->count * sizeof(struct memsnap_proc);
+	if (pwrite(snap_fd, snap_slot, size, sizeof(snap_file) +
+		   (off_t)snap_file.next * MEMSNAP_SLOT_SIZE) != size) {
+		PRT_TRACE_ERR("memory snapshot write failed");
+		snap_file.seq--;
+		return -1;
+	}
+
+	/*
+	 * The slot is on disk already. If the header write fails, readers
+	 * see the previous order until the next snapshot rewrites it.
+	 */
+	snap_file.next = (snap_file.next + 1) % MEMSNAP_SLOTS;
+	if (pwrite(snap_fd, &snap_file, sizeof(snap_file), 0) !=
+	    sizeof(snap_file)) {
+		PRT_TRACE_ERR("memory snapshot header write failed");
+		return -1;
+	}
+
+	if (hdr->skipped)
+		PRT_TRACE_ERR("memory snapshot %u truncated, %u skipped",
+			      hdr->seq, hdr->skipped);
+	PRT_TRACE("memory snapshot %u (%s) : %u processes in %u us",
+		  hdr->seq, reason, hdr->count, hdr->duration_us);
+	return 0;
+}
+
+int ss_memsnap_init(void)
+{
+	snap_fd = open(MEMSNAP_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0640);
+	if (snap_fd < 0) {
+		PRT_TRACE_ERR("%s open failed", MEMSNAP_FILE);
+		return -1;
+	}
+
+	if (pread(snap_fd, &snap_file, sizeof(snap_file), 0) ==
+	    sizeof(snap_file) && snap_file.magic == MEMSNAP_MAGIC &&
+	    snap_file.version == MEMSNAP_VERSION &&
+	    snap_file.slots == MEMSNAP_SLOTS &&
+	    snap_file.slot_size == MEMSNAP_SLOT_SIZE &&
+	    snap_file.next < MEMSNAP_SLOTS)
+		return 0;
+
+	/* new or from another layout, start over */
+	memset(&snap_file, 0, sizeof(snap_file));
+	snap_file.magic = MEMSNAP_MAGIC;
+	snap_file.version = MEMSNAP_VERSION;
+	snap_file.slots = MEMSNAP_SLOTS;
+	snap_file.slot_size = MEMSNAP_SLOT_SIZE;
+	if (ftruncate(snap_fd, 0) < 0 ||
+	    ftruncate(snap_fd, sizeof(snap_file) +
+		      MEMSNAP_SLOTS * MEMSNAP_SLOT_SIZE) < 0 ||
+	    pwrite(snap_fd, &snap_file, sizeof(snap_file), 0) !=
+	    sizeof(snap_file)) {
+		PRT_TRACE_ERR("%s init failed", MEMSNAP_FILE);
+		close(snap_fd);
+		snap_fd = -1;
+		return -1;
+	}
+	return 0;
+}
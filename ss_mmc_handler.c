@@ -25,18 +25,27 @@
 #include <sysman.h>
 #include "ss_log.h"
 #include "ss_device_handler.h"
+#include "ss_queue.h"
 
 #define MOVINAND_DEV		"/dev/mmcblk0p1"
 #define FORMAT_MMC		PREFIX"/sbin/mkfs.vfat "
 #define FORMAT_MOVINAND		PREFIX"/bin/movi_format.sh"
 
-int mmc_status;
+/* queued internally on card removal, not callable by clients */
+#define MMC_REMOVED_ACT		"mmc_removed"
+
+/*
+ * mmc actions set vconf keys and device properties, which are not
+ * thread-safe, so they all run on the main loop and mmc_status is only
+ * ever touched from there.
+ */
+static int mmc_status;
 
 int get_mmcblk_num()
 {
 	DIR *dp;
 	struct dirent *dir;
-	struct stat stat;
+	struct stat st;
 	char buf[255];
 	int fd;
 	int r;
@@ -46,12 +55,11 @@ int get_mmcblk_num()
 		PRT_TRACE_ERR("Can not open directory..\n");
 		return -1;
 	}
-	chdir("/sys/block");
 
 	while (dir = readdir(dp)) {
-		memset(&stat, 0, sizeof(struct stat));
-		lstat(dir->d_name, &stat);
-		if (S_ISDIR(stat.st_mode) || S_ISLNK(stat.st_mode)) {
+		memset(&st, 0, sizeof(struct stat));
+		fstatat(dirfd(dp), dir->d_name, &st, AT_SYMLINK_NOFOLLOW);
+		if (S_ISDIR(st.st_mode) || S_ISLNK(st.st_mode)) {
 			if (strncmp(".", dir->d_name, 1) == 0
 			    || strncmp("..", dir->d_name, 2) == 0)
 				continue;
@@ -131,21 +139,42 @@ int ss_mmc_unmounted(int argc, char **argv)
 	return 0;
 }
 
-int ss_mmc_init()
+static int mmc_internal_only(int caller_pid)
 {
-	/* mmc card mount */
-	ss_mmc_inserted();
+	return 0;
+}
+
+static int mmc_mount_action(int argc, char **argv);
+static int mmc_removed_action(int argc, char **argv);
 
-	ss_action_entry_add_internal(PREDEF_MOUNT_MMC, ss_mmc_inserted, NULL,
+int ss_mmc_init()
+{
+	ss_action_entry_add_internal(PREDEF_MOUNT_MMC, mmc_mount_action, NULL,
 				     NULL);
 	ss_action_entry_add_internal(PREDEF_UNMOUNT_MMC, ss_mmc_unmounted, NULL,
 				     NULL);
 	ss_action_entry_add_internal(PREDEF_FORMAT_MMC, ss_mmc_format, NULL,
 				     NULL);
+	ss_action_entry_add_internal(MMC_REMOVED_ACT, mmc_removed_action, NULL,
+				     mmc_internal_only);
+
+	/* mmc card mount */
+	ss_mmc_inserted();
 	return 0;
 }
 
+/* card events, queued so that they run in the order they came in */
 int ss_mmc_inserted()
+{
+	return ss_action_entry_call_internal_id(SS_ACTION_MOUNT_MMC, 0);
+}
+
+int ss_mmc_removed()
+{
+	return ss_action_entry_call_internal(MMC_REMOVED_ACT, 0);
+}
+
+static int mmc_mount_action(int argc, char **argv)
 {
 	char buf[NAME_MAX];
 	int blk_num, ret, retry = 0;
@@ -213,7 +242,7 @@ int ss_mmc_inserted()
 	return -1;
 }
 
-int ss_mmc_removed()
+static int mmc_removed_action(int argc, char **argv)
 {
 	vconf_set_int(VCONFKEY_SYSMAN_MMC_STATUS, VCONFKEY_SYSMAN_MMC_REMOVED);
 
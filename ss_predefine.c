@@ -30,6 +30,7 @@
 #include <syspopup_caller.h>
 #include <sys/reboot.h>
 #include <sys/time.h>
+#include <sys/inotify.h>
 
 #include "ss_log.h"
 #include "ss_launch.h"
@@ -38,6 +39,7 @@
 #include "ss_device_plugin.h"
 #include "ss_predefine.h"
 #include "ss_procmgr.h"
+#include "ss_memsnap.h"
 #include "include/ss_data.h"
 
 #define PREDEFINE_SO_DIR			PREFIX"/lib/ss_predefine/"
@@ -55,7 +57,6 @@
 
 #define TVOUT_X_BIN				"/usr/bin/xberc"
 #define TVOUT_FLAG				0x00000001
-#define MEMPS_LOG_FILE				"/var/log/memps"
 #define MAX_RETRY				2
 
 #define POWEROFF_DURATION			2
@@ -80,55 +81,16 @@ static int ss_flags = 0;
 static Ecore_Timer *poweroff_timer_id = NULL;
 static TapiHandle *tapi_handle = NULL;
 
-static void make_memps_log(char *file, pid_t pid, char *victim_name)
+/* written in process, forking memps now would compete for memory */
+static void make_memps_log(pid_t pid, char *victim_name)
 {
-	time_t now;
-	struct tm *cur_tm;
-	char params[4096];
-	char new_log[NAME_MAX];
 	static pid_t old_pid = 0;
-	int ret=-1;
 
 	if (old_pid == pid)
 		return;
 	old_pid = pid;
 
-	now = time(NULL);
-	cur_tm = (struct tm *)malloc(sizeof(struct tm));
-	if (cur_tm == NULL) {
-		PRT_TRACE_ERR("Fail to memory allocation");
-		return;
-	}
-
-	if (localtime_r(&now, cur_tm) == NULL) {
-		PRT_TRACE_ERR("Fail to get localtime");
-		return;
-	}
-
-	PRT_TRACE("%s_%s_%d_%.4d%.2d%.2d_%.2d%.2d%.2d.log", file, victim_name,
-		 pid, (1900 + cur_tm->tm_year), 1 + cur_tm->tm_mon,
-		 cur_tm->tm_mday, cur_tm->tm_hour, cur_tm->tm_min,
-		 cur_tm->tm_sec);
-	snprintf(new_log, sizeof(new_log),
-		 "%s_%s_%d_%.4d%.2d%.2d_%.2d%.2d%.2d.log", file, victim_name,
-		 pid, (1900 + cur_tm->tm_year), 1 + cur_tm->tm_mon,
-		 cur_tm->tm_mday, cur_tm->tm_hour, cur_tm->tm_min,
-		 cur_tm->tm_sec);
-
-	snprintf(params, sizeof(params), "-f %s", new_log);
-	ret = ss_launch_evenif_exist(MEMPS_EXEC_PATH, params);
-
-	if(ret > 0) {
-		char buf[PATH_MAX];
-		FILE *fp;
-		snprintf(buf, sizeof(buf), "/proc/%d/oom_adj", ret);
-		fp = fopen(buf, "w");
-		if (fp != NULL) {
-			fprintf(fp, "%d", (-17));
-			fclose(fp);
-		}
-	}
-	free(cur_tm);
+	ss_memsnap_write(pid, victim_name);
 }
 
 static int lowmem_get_victim_pid()
@@ -153,6 +115,13 @@ int lowmem_def_predefine_action(int argc, char **argv)
 		return -1;
 
 	if (!strcmp(argv[0], OOM_MEM_ACT)) {
+		/* the last victim has not released its memory yet */
+		if (ss_procmgr_kills_pending() > 0)
+			return 0;
+		/* background apps first, the kernel's victim only if none */
+		if (ss_procmgr_reclaim() >= 0)
+			return 0;
+
 		pid = lowmem_get_victim_pid();
 		if (pid > 0 && pid != sysman_get_pid(LOWMEM_EXEC_PATH) && pid != sysman_get_pid(MEMPS_EXEC_PATH)) {
 			if ((sysman_get_cmdline_name(pid, appname, PATH_MAX)) ==
@@ -161,14 +130,14 @@ int lowmem_def_predefine_action(int argc, char **argv)
 				    ("we will kill, lowmem lv2 = %d (%s)\n",
 				     pid, appname);
 	
-				make_memps_log(MEMPS_LOG_FILE, pid, appname);
+				make_memps_log(pid, appname);
 
 				if(get_app_oomadj(pid, &oom_adj) < 0) {
 					PRT_TRACE_ERR("Failed to get oom_adj");
 				}
 				PRT_TRACE("%d will be killed with %d oom_adj value", pid, oom_adj);
 
-				kill(pid, SIGTERM);
+				ss_procmgr_kill(pid);
 
 				if (oom_adj >= OOMADJ_BACKGRD_UNLOCKED) {	
 					return 0;
@@ -192,7 +161,7 @@ int lowmem_def_predefine_action(int argc, char **argv)
 		}
 	} else {
 		PRT_TRACE_EM("making memps log for low memory\n");
-		make_memps_log(MEMPS_LOG_FILE, 1, "LOWMEM_WARNING");
+		make_memps_log(1, "LOWMEM_WARNING");
 	}
 
 	return 0;
@@ -333,17 +302,14 @@ int lowbat_def_predefine_action(int argc, char **argv)
 	return 0;
 }
 
-Eina_Bool powerdown_ap_by_force(void *data)
+/* seconds left until the power off animation has run for PWROFF_DUR */
+static double poweroff_remaining(void)
 {
 	struct timeval now;
 	int poweroff_duration = POWEROFF_DURATION;
 	char *buf;
+	double elapsed;
 
-	if(tapi_handle != NULL)
-	{
-		tel_deinit(tapi_handle);
-		tapi_handle = NULL;
-	}
 	/* Getting poweroff duration */
 	buf = getenv("PWROFF_DUR");
 	if (buf != NULL && strlen(buf) < 1024)
@@ -352,27 +318,65 @@ Eina_Bool powerdown_ap_by_force(void *data)
 		poweroff_duration = POWEROFF_DURATION;
 
 	gettimeofday(&now, NULL);
-	/* Waiting until power off duration and displaying animation */
-	while (now.tv_sec - tv_start_poweroff.tv_sec < poweroff_duration) {
-		usleep(100000);
-		gettimeofday(&now, NULL);
-	}
+	elapsed = (now.tv_sec - tv_start_poweroff.tv_sec) +
+	    (now.tv_usec - tv_start_poweroff.tv_usec) / 1000000.0;
+	if (elapsed >= poweroff_duration)
+		return 0;
+	return poweroff_duration - elapsed;
+}
 
-	PRT_TRACE("Power off by force\n");
-	kill(-1, SIGTERM);
-	/* give a chance to be terminated for each process */
-	sleep(1);
+static Eina_Bool poweroff_reboot_cb(void *data)
+{
 	sync();
 	reboot(RB_POWER_OFF);
-	return EINA_TRUE;
+	return EINA_FALSE;
 }
 
-static void powerdown_ap(TapiHandle *handle, const char *noti_id, void *data, void *user_data)
+static Eina_Bool poweroff_kill_cb(void *data)
 {
-	struct timeval now;
-	int poweroff_duration = POWEROFF_DURATION;
-	char *buf;
+	PRT_TRACE("Power off\n");
+	kill(-1, SIGTERM);
+	/* give a chance to be terminated for each process */
+	ecore_timer_add(1, poweroff_reboot_cb, NULL);
+	return EINA_FALSE;
+}
 
+static Eina_Bool restart_reboot_cb(void *data)
+{
+	reboot(RB_AUTOBOOT);
+	return EINA_FALSE;
+}
+
+/*
+ * Wait for the rest of the animation on a timer instead of sleeping, so
+ * the main loop keeps serving requests while the device goes down.
+ */
+static void shutdown_schedule(Ecore_Task_Cb func)
+{
+	static int scheduled;
+
+	if (scheduled)
+		return;
+	scheduled = 1;
+	ecore_timer_add(poweroff_remaining(), func, NULL);
+}
+
+Eina_Bool powerdown_ap_by_force(void *data)
+{
+	poweroff_timer_id = NULL;
+	if(tapi_handle != NULL)
+	{
+		tel_deinit(tapi_handle);
+		tapi_handle = NULL;
+	}
+
+	PRT_TRACE("Power off by force\n");
+	shutdown_schedule(poweroff_kill_cb);
+	return EINA_FALSE;
+}
+
+static void powerdown_ap(TapiHandle *handle, const char *noti_id, void *data, void *user_data)
+{
 	if (poweroff_timer_id) {
 		ecore_timer_del(poweroff_timer_id);
 		poweroff_timer_id = NULL;
@@ -383,26 +387,7 @@ static void powerdown_ap(TapiHandle *handle, const char *noti_id, void *data, vo
 		tapi_handle = NULL;
 	}
 	PRT_TRACE("Power off \n");
-
-	/* Getting poweroff duration */
-	buf = getenv("PWROFF_DUR");
-	if (buf != NULL && strlen(buf) < 1024)
-		poweroff_duration = atoi(buf);
-	if (poweroff_duration < 0 || poweroff_duration > 60)
-		poweroff_duration = POWEROFF_DURATION;
-
-	gettimeofday(&now, NULL);
-	/* Waiting until power off duration and displaying animation */
-	while (now.tv_sec - tv_start_poweroff.tv_sec < poweroff_duration) {
-		usleep(100000);
-		gettimeofday(&now, NULL);
-	}
-
-	kill(-1, SIGTERM);
-	/* give a chance to be terminated for each process */
-	sleep(1);
-	sync();
-	reboot(RB_POWER_OFF);
+	shutdown_schedule(poweroff_kill_cb);
 }
 static void powerdown_res_cb(TapiHandle *handle, int result, void *data, void *user_data)
 {
@@ -415,7 +400,7 @@ int poweroff_def_predefine_action(int argc, char **argv)
 	heynoti_publish(POWEROFF_NOTI_NAME);
 
 	pm_change_state(LCD_NORMAL);
-	system("/etc/rc.d/rc.shutdown &");
+	ss_launch_evenif_exist("/etc/rc.d/rc.shutdown", "");
 	sync();
 
 	gettimeofday(&tv_start_poweroff, NULL);
@@ -488,10 +473,6 @@ Eina_Bool restart_ap_ecore(void *data)
 
 static void restart_ap(TapiHandle *handle, const char *noti_id, void *data, void *user_data)
 {
-	struct timeval now;
-	int poweroff_duration = POWEROFF_DURATION;
-	char *buf;
-
 	if (poweroff_timer_id) {
 		ecore_timer_del(poweroff_timer_id);
 		poweroff_timer_id = NULL;
@@ -507,27 +488,11 @@ static void restart_ap(TapiHandle *handle, const char *noti_id, void *data, void
 
 	PRT_INFO("Restart\n");
 	sync();
-
-	buf = getenv("PWROFF_DUR");
-	if (buf != NULL && strlen(buf) < 1024)
-		poweroff_duration = atoi(buf);
-	if (poweroff_duration < 0 || poweroff_duration > 60)
-		poweroff_duration = POWEROFF_DURATION;
-	gettimeofday(&now, NULL);
-	while (now.tv_sec - tv_start_poweroff.tv_sec < poweroff_duration) {
-		usleep(100000);
-		gettimeofday(&now, NULL);
-	}
-
-	reboot(RB_AUTOBOOT);
+	shutdown_schedule(restart_reboot_cb);
 }
 
 static void restart_ap_by_force(void *data)
 {
-	struct timeval now;
-	int poweroff_duration = POWEROFF_DURATION;
-	char *buf;
-
 	if (poweroff_timer_id) {
 		ecore_timer_del(poweroff_timer_id);
 		poweroff_timer_id = NULL;
@@ -542,19 +507,7 @@ static void restart_ap_by_force(void *data)
 
 	PRT_INFO("Restart\n");
 	sync();
-
-	buf = getenv("PWROFF_DUR");
-	if (buf != NULL && strlen(buf) < 1024)
-		poweroff_duration = atoi(buf);
-	if (poweroff_duration < 0 || poweroff_duration > 60)
-		poweroff_duration = POWEROFF_DURATION;
-	gettimeofday(&now, NULL);
-	while (now.tv_sec - tv_start_poweroff.tv_sec < poweroff_duration) {
-		usleep(100000);
-		gettimeofday(&now, NULL);
-	}
-
-	reboot(RB_AUTOBOOT);
+	shutdown_schedule(restart_reboot_cb);
 }
 
 int restart_def_predefine_action(int argc, char **argv)
@@ -562,7 +515,7 @@ int restart_def_predefine_action(int argc, char **argv)
 	int ret;
 
 	pm_change_state(LCD_NORMAL);
-	system("/etc/rc.d/rc.shutdown &");
+	ss_launch_evenif_exist("/etc/rc.d/rc.shutdown", "");
 	sync();
 
 	gettimeofday(&tv_start_poweroff, NULL);
@@ -604,13 +557,127 @@ int launching_predefine_action(int argc, char **argv)
 	return 0;
 }
 
+/* "lib<type>.so" -> "<type>", NULL for anything else */
+static char *plugin_type(const char *name, char *type, int size)
+{
+	const char *ext;
+	int len;
+
+	if (strncmp(name, "lib", 3) != 0)
+		return NULL;
+	ext = strstr(name, ".so");
+	if (ext == NULL || strcmp(ext, ".so") != 0)
+		return NULL;
+	len = ext - name - 3;
+	if (len <= 0 || len >= size)
+		return NULL;
+	memcpy(type, name + 3, len);
+	type[len] = '\0';
+	return type;
+}
+
+/* ADD_SYSMAN_ACTION: only plugins installed in PREDEFINE_SO_DIR */
+int ss_predefine_plugin_add(struct sysnoti *msg)
+{
+	char real[PATH_MAX];
+	char type[NAME_MAX];
+	const char *name;
+
+	if (msg->path == NULL || realpath(msg->path, real) == NULL)
+		return -1;
+	if (strncmp(real, PREDEFINE_SO_DIR, strlen(PREDEFINE_SO_DIR)) != 0)
+		return -1;
+
+	name = real + strlen(PREDEFINE_SO_DIR);
+	if (strchr(name, '/') != NULL || msg->type == NULL ||
+	    plugin_type(name, type, sizeof(type)) == NULL ||
+	    strcmp(type, msg->type) != 0)
+		return -1;
+
+	msg->path = real;
+	return ss_action_entry_add(msg);
+}
+
+static int plugin_dir_fd = -1;
+
+/*
+ * Plugins are picked up when written or moved into PREDEFINE_SO_DIR and
+ * dropped when deleted or moved away. A rewritten library is reloaded
+ * once its running entries have retired.
+ */
+static int plugin_dir_cb(void *data, Ecore_Fd_Handler *fd_handler)
+{
+	char buf[4096]
+	    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	struct sysnoti msg;
+	char type[NAME_MAX];
+	char path[PATH_MAX];
+	char *p;
+	int len;
+
+	if (!ecore_main_fd_handler_active_get(fd_handler, ECORE_FD_READ)) {
+		PRT_TRACE_ERR
+		    ("ecore_main_fd_handler_active_get error , return\n");
+		return 1;
+	}
+
+	while ((len = read(plugin_dir_fd, buf, sizeof(buf))) > 0) {
+		for (p = buf; p < buf + len;
+		     p += sizeof(struct inotify_event) + ev->len) {
+			ev = (const struct inotify_event *)p;
+			if (ev->len == 0 ||
+			    plugin_type(ev->name, type, sizeof(type)) == NULL)
+				continue;
+
+			if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+				ss_action_entry_del(type);
+				continue;
+			}
+			if (ss_action_entry_reload(type) == 0)
+				continue;
+
+			snprintf(path, sizeof(path), "%s%s",
+				 PREDEFINE_SO_DIR, ev->name);
+			msg.pid = getpid();
+			msg.type = type;
+			msg.path = path;
+			ss_action_entry_add(&msg);
+		}
+	}
+	return 1;
+}
+
+static void plugin_dir_watch(void)
+{
+	plugin_dir_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (plugin_dir_fd < 0) {
+		PRT_TRACE_ERR("inotify init failed");
+		return;
+	}
+
+	if (inotify_add_watch(plugin_dir_fd, PREDEFINE_SO_DIR,
+			      IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE |
+			      IN_MOVED_FROM) < 0) {
+		PRT_TRACE_ERR("cannot watch %s", PREDEFINE_SO_DIR);
+		close(plugin_dir_fd);
+		plugin_dir_fd = -1;
+		return;
+	}
+
+	ecore_main_fd_handler_add(plugin_dir_fd, ECORE_FD_READ,
+				  plugin_dir_cb, NULL, NULL, NULL);
+}
+
 static void ss_action_entry_load_from_sodir()
 {
 	DIR *dp;
 	struct dirent *dentry;
 	struct sysnoti *msg;
-	char *ext;
-	char tmp[128];
+	char type[NAME_MAX];
+	char tmp[PATH_MAX];
+	double start = ecore_time_get();
+	int cnt = 0;
 
 	dp = opendir(PREDEFINE_SO_DIR);
 	if (!dp) {
@@ -628,18 +695,22 @@ static void ss_action_entry_load_from_sodir()
 	msg->pid = getpid();
 
 	while ((dentry = readdir(dp)) != NULL) {
-		if ((ext = strstr(dentry->d_name, ".so")) == NULL)
+		if (plugin_type(dentry->d_name, type, sizeof(type)) == NULL)
 			continue;
 
-		snprintf(tmp, sizeof(tmp), "%s/%s", PREDEFINE_SO_DIR,
+		snprintf(tmp, sizeof(tmp), "%s%s", PREDEFINE_SO_DIR,
 			 dentry->d_name);
 		msg->path = tmp;
-		*ext = 0;
-		msg->type = &(dentry->d_name[3]);
-		ss_action_entry_add(msg);
+		msg->type = type;
+		if (ss_action_entry_add(msg) == 0)
+			cnt++;
 	}
 	free(msg);
 
+	/* registration only, the libraries are loaded on first call */
+	PRT_TRACE("[SYSMAN] %d plugins registered in %.3f ms", cnt,
+		  (ecore_time_get() - start) * 1000);
+
 	closedir(dp);
 }
 
@@ -658,6 +729,7 @@ void ss_predefine_internal_init(void)
 #endif
 	ss_action_entry_add_internal(PREDEF_LOWMEM, lowmem_def_predefine_action,
 				     NULL, NULL);
+	ss_memsnap_init();
 	ss_action_entry_add_internal(PREDEF_LOWBAT, lowbat_def_predefine_action,
 				     NULL, NULL);
 	ss_action_entry_add_internal(PREDEF_USBCON, usbcon_def_predefine_action,
@@ -672,7 +744,12 @@ void ss_predefine_internal_init(void)
 	ss_action_entry_add_internal(PREDEF_REBOOT,
 				     restart_def_predefine_action, NULL, NULL);
 
+	ss_action_entry_set_prio(PREDEF_LOWMEM, SS_PRIO_CRITICAL);
+	ss_action_entry_set_prio(PREDEF_POWEROFF, SS_PRIO_CRITICAL);
+	ss_action_entry_set_prio(PREDEF_REBOOT, SS_PRIO_CRITICAL);
+
 	ss_action_entry_load_from_sodir();
+	plugin_dir_watch();
 
 	/* check and set earjack init status */
 	earjackcon_def_predefine_action(0, NULL);
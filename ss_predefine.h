@@ -18,7 +18,10 @@
 #ifndef __SS_PREDEFINE_H__
 #define __SS_PREDEFINE_H__
 
+#include "ss_sysnoti.h"
+
 int call_predefine_action(int argc, char **argv);
 void ss_predefine_internal_init(void);
+int ss_predefine_plugin_add(struct sysnoti *msg);
 
 #endif /* __SS_PREDEFINE_H__ */
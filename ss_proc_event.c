@@ -0,0 +1,420 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#include <Ecore.h>
+#include "ss_log.h"
+#include "ss_proc_event.h"
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open	434
+#endif
+
+/*
+ * Exits and execs come from the netlink proc connector, which needs
+ * CAP_NET_ADMIN and CONFIG_PROC_EVENTS. Without it each watched pid gets
+ * a pidfd that turns readable on exit, and on kernels without pidfds a
+ * slow timer checks the watched pids. The timer also resyncs after the
+ * netlink socket overflowed.
+ */
+enum proc_event_mode {
+	PROC_MODE_NETLINK,
+	PROC_MODE_PIDFD,
+	PROC_MODE_POLL
+};
+
+#define PROC_POLL_INTERVAL	5	/* seconds */
+
+struct proc_sub {
+	ss_proc_event_cb cb;	/* NULL once unsubscribed during dispatch */
+	void *data;
+	unsigned int events;
+};
+
+struct proc_watch {
+	int pid;
+	int pidfd;
+	Ecore_Fd_Handler *handler;
+	Eina_List *subs;
+	int busy;		/* callbacks running, defer frees */
+};
+
+static enum proc_event_mode proc_mode = PROC_MODE_POLL;
+static Eina_Hash *proc_watch_hash;
+static Ecore_Timer *proc_poll_timer;
+static int proc_nl_fd = -1;
+
+static void proc_watch_free(struct proc_watch *w)
+{
+	struct proc_sub *sub;
+
+	if (w->handler)
+		ecore_main_fd_handler_del(w->handler);
+	if (w->pidfd >= 0)
+		close(w->pidfd);
+	EINA_LIST_FREE(w->subs, sub)
+		free(sub);
+	free(w);
+}
+
+static void proc_watch_purge(struct proc_watch *w)
+{
+	Eina_List *l, *l_next;
+	struct proc_sub *sub;
+
+	EINA_LIST_FOREACH_SAFE(w->subs, l, l_next, sub) {
+		if (sub->cb == NULL) {
+			w->subs = eina_list_remove_list(w->subs, l);
+			free(sub);
+		}
+	}
+}
+
+static void proc_dispatch(int pid, enum ss_proc_event event)
+{
+	struct proc_watch *w;
+	struct proc_sub *sub;
+	Eina_List *l;
+
+	w = eina_hash_find(proc_watch_hash, &pid);
+	if (w == NULL)
+		return;
+
+	/* an exit ends the watch, later lookups must not find it */
+	if (event == SS_PROC_EVENT_EXIT)
+		eina_hash_del(proc_watch_hash, &w->pid, w);
+
+	w->busy++;
+	EINA_LIST_FOREACH(w->subs, l, sub) {
+		if (sub->cb && (sub->events & event))
+			sub->cb(pid, event, sub->data);
+	}
+	w->busy--;
+
+	if (event == SS_PROC_EVENT_EXIT) {
+		proc_watch_free(w);
+		return;
+	}
+
+	proc_watch_purge(w);
+	if (w->subs == NULL) {
+		eina_hash_del(proc_watch_hash, &w->pid, w);
+		proc_watch_free(w);
+	}
+}
+
+static int proc_alive(int pid)
+{
+	return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+static Eina_Bool proc_check_cb(const Eina_Hash *hash, const void *key,
+			       void *data, void *fdata)
+{
+	struct proc_watch *w = data;
+	Eina_List **dead = fdata;
+
+	if (w->pidfd < 0 && !proc_alive(w->pid))
+		*dead = eina_list_append(*dead, (void *)(long)w->pid);
+	return EINA_TRUE;
+}
+
+static void proc_check_all(void)
+{
+	Eina_List *dead = NULL;
+	void *pid;
+
+	eina_hash_foreach(proc_watch_hash, proc_check_cb, &dead);
+	EINA_LIST_FREE(dead, pid)
+		proc_dispatch((int)(long)pid, SS_PROC_EVENT_EXIT);
+}
+
+static Eina_Bool proc_poll_cb(void *data)
+{
+	proc_check_all();
+	if (eina_hash_population(proc_watch_hash) > 0)
+		return EINA_TRUE;
+	proc_poll_timer = NULL;
+	return EINA_FALSE;
+}
+
+static void proc_poll_start(void)
+{
+	if (proc_poll_timer == NULL)
+		proc_poll_timer = ecore_timer_add(PROC_POLL_INTERVAL,
+						  proc_poll_cb, NULL);
+}
+
+static int proc_nl_listen(int fd, enum proc_cn_mcast_op op)
+{
+	char buf[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(op))];
+	struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+	struct cn_msg *cn;
+
+	memset(buf, 0, sizeof(buf));
+	nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(op));
+	nlh->nlmsg_type = NLMSG_DONE;
+	nlh->nlmsg_pid = getpid();
+
+	cn = NLMSG_DATA(nlh);
+	cn->id.idx = CN_IDX_PROC;
+	cn->id.val = CN_VAL_PROC;
+	cn->len = sizeof(op);
+	memcpy(cn->data, &op, sizeof(op));
+
+	if (send(fd, nlh, nlh->nlmsg_len, 0) != nlh->nlmsg_len)
+		return -1;
+	return 0;
+}
+
+static void proc_nl_event(struct proc_event *ev)
+{
+	switch (ev->what) {
+	case PROC_EVENT_EXIT:
+		/* thread exits are not interesting */
+		if (ev->event_data.exit.process_pid ==
+		    ev->event_data.exit.process_tgid)
+			proc_dispatch(ev->event_data.exit.process_tgid,
+				      SS_PROC_EVENT_EXIT);
+		break;
+	case PROC_EVENT_EXEC:
+		proc_dispatch(ev->event_data.exec.process_tgid,
+			      SS_PROC_EVENT_EXEC);
+		break;
+	default:
+		break;
+	}
+}
+
+static Eina_Bool proc_nl_cb(void *data, Ecore_Fd_Handler *fd_handler)
+{
+	char buf[4096] __attribute__ ((aligned(NLMSG_ALIGNTO)));
+	struct sockaddr_nl from;
+	socklen_t from_len;
+	struct nlmsghdr *nlh;
+	struct cn_msg *cn;
+	int len;
+
+	for (;;) {
+		from_len = sizeof(from);
+		len = recvfrom(proc_nl_fd, buf, sizeof(buf), 0,
+			       (struct sockaddr *)&from, &from_len);
+		if (len == 0)
+			break;
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOBUFS) {
+				PRT_TRACE_ERR("proc connector overflow, resync");
+				proc_check_all();
+				continue;
+			}
+			break;
+		}
+
+		/* only the kernel may report process events, drop forgeries */
+		if (from_len != sizeof(from) || from.nl_family != AF_NETLINK ||
+		    from.nl_pid != 0) {
+			PRT_TRACE_ERR("proc event from port %u dropped",
+				      from.nl_pid);
+			continue;
+		}
+
+		for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len);
+		     nlh = NLMSG_NEXT(nlh, len)) {
+			if (nlh->nlmsg_type == NLMSG_NOOP)
+				continue;
+			if (nlh->nlmsg_type == NLMSG_ERROR ||
+			    nlh->nlmsg_type == NLMSG_OVERRUN)
+				break;
+			if (nlh->nlmsg_pid != 0 ||
+			    nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*cn) +
+						sizeof(struct proc_event)))
+				continue;
+			cn = NLMSG_DATA(nlh);
+			if (cn->id.idx != CN_IDX_PROC ||
+			    cn->id.val != CN_VAL_PROC)
+				continue;
+			proc_nl_event((struct proc_event *)cn->data);
+		}
+	}
+
+	return 1;
+}
+
+static int proc_nl_init(void)
+{
+	struct sockaddr_nl addr;
+	int fd;
+
+	fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+		    NETLINK_CONNECTOR);
+	if (fd < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = CN_IDX_PROC;
+	addr.nl_pid = getpid();
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    proc_nl_listen(fd, PROC_CN_MCAST_LISTEN) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	if (ecore_main_fd_handler_add(fd, ECORE_FD_READ, proc_nl_cb, NULL,
+				      NULL, NULL) == NULL) {
+		close(fd);
+		return -1;
+	}
+
+	proc_nl_fd = fd;
+	return 0;
+}
+
+static Eina_Bool proc_pidfd_cb(void *data, Ecore_Fd_Handler *fd_handler)
+{
+	struct proc_watch *w = data;
+
+	/* frees the watch and with it this handler */
+	proc_dispatch(w->pid, SS_PROC_EVENT_EXIT);
+	return 1;
+}
+
+static int proc_watch_arm(struct proc_watch *w)
+{
+	if (proc_mode == PROC_MODE_PIDFD) {
+		w->pidfd = syscall(SYS_pidfd_open, w->pid, 0);
+		if (w->pidfd < 0 && errno == ENOSYS) {
+			PRT_TRACE_ERR("no pidfd support, polling for exits");
+			proc_mode = PROC_MODE_POLL;
+		} else if (w->pidfd < 0) {
+			return -1;
+		} else {
+			w->handler = ecore_main_fd_handler_add(w->pidfd,
+					ECORE_FD_READ, proc_pidfd_cb, w,
+					NULL, NULL);
+			if (w->handler == NULL) {
+				close(w->pidfd);
+				w->pidfd = -1;
+				return -1;
+			}
+			return 0;
+		}
+	}
+
+	if (proc_mode == PROC_MODE_POLL)
+		proc_poll_start();
+	return 0;
+}
+
+int ss_proc_event_subscribe(int pid, unsigned int events,
+			    ss_proc_event_cb cb, void *data)
+{
+	struct proc_watch *w;
+	struct proc_sub *sub;
+
+	if (pid <= 0 || cb == NULL || proc_watch_hash == NULL)
+		return -1;
+
+	w = eina_hash_find(proc_watch_hash, &pid);
+	if (w == NULL) {
+		/* an exit before this point would never be reported */
+		if (!proc_alive(pid))
+			return -1;
+
+		w = calloc(1, sizeof(struct proc_watch));
+		if (w == NULL)
+			return -1;
+		w->pid = pid;
+		w->pidfd = -1;
+		if (proc_watch_arm(w) < 0 ||
+		    !eina_hash_add(proc_watch_hash, &w->pid, w)) {
+			proc_watch_free(w);
+			return -1;
+		}
+	}
+
+	sub = malloc(sizeof(struct proc_sub));
+	if (sub == NULL)
+		goto err;
+	sub->cb = cb;
+	sub->data = data;
+	sub->events = events;
+	w->subs = eina_list_append(w->subs, sub);
+	return 0;
+
+err:
+	if (w->subs == NULL) {
+		eina_hash_del(proc_watch_hash, &w->pid, w);
+		proc_watch_free(w);
+	}
+	return -1;
+}
+
+void ss_proc_event_unsubscribe(int pid, ss_proc_event_cb cb, void *data)
+{
+	struct proc_watch *w;
+	struct proc_sub *sub;
+	Eina_List *l;
+
+	if (proc_watch_hash == NULL)
+		return;
+	w = eina_hash_find(proc_watch_hash, &pid);
+	if (w == NULL)
+		return;
+
+	EINA_LIST_FOREACH(w->subs, l, sub) {
+		if (sub->cb == cb && sub->data == data) {
+			sub->cb = NULL;
+			break;
+		}
+	}
+	if (w->busy)
+		return;
+
+	proc_watch_purge(w);
+	if (w->subs == NULL) {
+		eina_hash_del(proc_watch_hash, &w->pid, w);
+		proc_watch_free(w);
+	}
+}
+
+int ss_proc_event_init(void)
+{
+	proc_watch_hash = eina_hash_int32_new(NULL);
+	if (proc_watch_hash == NULL) {
+		PRT_TRACE_ERR("proc event table init failed");
+		return -1;
+	}
+
+	if (proc_nl_init() == 0)
+		proc_mode = PROC_MODE_NETLINK;
+	else
+		proc_mode = PROC_MODE_PIDFD;
+	PRT_TRACE("proc event mode : %s",
+		  proc_mode == PROC_MODE_NETLINK ? "netlink" : "pidfd");
+	return 0;
+}
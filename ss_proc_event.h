@@ -0,0 +1,41 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+
+#ifndef __SS_PROC_EVENT_H__
+#define __SS_PROC_EVENT_H__
+
+/*
+ * Process lifecycle notifications. Modules that keep per-pid state
+ * subscribe to the pids they track and drop the state from the callback
+ * instead of checking /proc later on.
+ */
+enum ss_proc_event {
+	SS_PROC_EVENT_EXIT = 0x1,
+	SS_PROC_EVENT_EXEC = 0x2,	/* only with the proc connector */
+};
+
+typedef void (*ss_proc_event_cb) (int pid, enum ss_proc_event event,
+				  void *data);
+
+/* fails if the pid does not exist; an exit ends every subscription */
+int ss_proc_event_subscribe(int pid, unsigned int events,
+			    ss_proc_event_cb cb, void *data);
+void ss_proc_event_unsubscribe(int pid, ss_proc_event_cb cb, void *data);
+
+int ss_proc_event_init(void);
+
+#endif /* __SS_PROC_EVENT_H__ */
@@ -19,175 +19,924 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 
 #include <sysman.h>
 #include "include/ss_data.h"
 #include "ss_queue.h"
 #include "ss_log.h"
+#include "ss_procmgr.h"
+#include "ss_proc_event.h"
+#include "ss_memsnap.h"
 
 #define LIMITED_PROCESS_OOMADJ 15
 
-int get_app_oomadj(int pid, int *oomadj)
+/*
+ * OOM state of the apps this process manager has handled, so that an
+ * app switch does not have to scan /proc. Apps in the background range
+ * are also linked on proc_oom_bg, most recently backgrounded first; that
+ * LRU is the only thing aging has to visit.
+ *
+ * Every entry holds two fds, plus a pidfd for its exit watch, so the
+ * table is capped at PROC_OOM_MAX: the least recently used foreground
+ * entry makes room, and only then the oldest background one. Aging
+ * keeps the background set far below the cap anyway.
+ */
+#define PROC_OOM_MAX		128
+
+struct proc_oom {
+	EINA_INLIST;
+	int pid;
+	int oomadj;
+	int bg;
+	double bg_since;	/* ecore_time_get() when it went background */
+	unsigned int used;	/* proc_oom_tick at the last lookup */
+	int dirfd;		/* /proc/<pid> */
+	int oomfd;		/* oom file under dirfd, -1 until used */
+};
+
+static Eina_Hash *proc_oom_hash;
+static Eina_Inlist *proc_oom_bg;
+static unsigned int proc_oom_tick;
+
+/* why a victim is killed, only aging kills do not hold back OOM handling */
+enum proc_kill_kind {
+	PROC_KILL_AGING,
+	PROC_KILL_OOM,
+	PROC_KILL_RECLAIM
+};
+
+static int proc_kill_start(int pid, enum proc_kill_kind kind);
+
+/*
+ * Background apps get the oom_adj of the tier their LRU rank falls in;
+ * apps ranked past the last tier are terminated. SS_BG_TIERS overrides
+ * the tiers as "count:oom_adj,...", and SS_BG_POLICY=memory ranks by
+ * idle time times resident size instead of recency, so that big idle
+ * apps are demoted first.
+ */
+#define BG_TIER_MAX		8
+#define BG_TIERS_ENV		"SS_BG_TIERS"
+#define BG_POLICY_ENV		"SS_BG_POLICY"
+
+struct bg_tier {
+	int count;
+	int oomadj;
+};
+
+enum bg_policy {
+	BG_POLICY_LRU,
+	BG_POLICY_MEMORY
+};
+
+static struct bg_tier bg_tiers[BG_TIER_MAX] = {
+	{2, OOMADJ_BACKGRD_UNLOCKED},
+	{4, 5},
+	{4, 10},
+	{5, LIMITED_PROCESS_OOMADJ},
+};
+static int bg_tier_cnt = 4;
+static enum bg_policy bg_policy = BG_POLICY_LRU;
+
+/*
+ * oom_adj is deprecated, so oom_score_adj is written when the kernel has
+ * it. The table and the callers keep talking in OOMADJ_* values, which
+ * are converted the way the kernel converts them itself. Each managed
+ * pid keeps its /proc directory open, so a reused pid is never written
+ * by mistake, and the oom file is opened once and written with pwrite.
+ */
+enum oom_backend {
+	OOM_BACKEND_ADJ,
+	OOM_BACKEND_SCORE
+};
+
+#define OOM_ADJUST_MAX		15
+#define OOM_SCORE_ADJ_MAX	1000
+
+static enum oom_backend oom_backend = OOM_BACKEND_ADJ;
+static const char *oom_file[] = {
+	[OOM_BACKEND_ADJ] = "oom_adj",
+	[OOM_BACKEND_SCORE] = "oom_score_adj",
+};
+
+static int oomadj_to_score(int oomadj)
 {
-	if (pid < 0)
-		return -1;
+	if (oomadj == OOM_ADJUST_MAX)
+		return OOM_SCORE_ADJ_MAX;
+	return oomadj * OOM_SCORE_ADJ_MAX / -OOMADJ_SU;
+}
+
+/*
+ * oomadj_to_score() truncates by less than one score unit, i.e. less
+ * than 0.017 oom_adj, so rounding to the nearest oom_adj gets back
+ * exactly the value that was written.
+ */
+static int score_to_oomadj(int score)
+{
+	if (score >= OOM_SCORE_ADJ_MAX)
+		return OOM_ADJUST_MAX;
+	if (score >= 0)
+		return (score * -OOMADJ_SU + OOM_SCORE_ADJ_MAX / 2) /
+		    OOM_SCORE_ADJ_MAX;
+	return -((-score * -OOMADJ_SU + OOM_SCORE_ADJ_MAX / 2) /
+		 OOM_SCORE_ADJ_MAX);
+}
+
+/* every oom_adj must come back unchanged, or the state machine misfires */
+static int oom_convert_check(void)
+{
+	int oomadj;
+
+	for (oomadj = OOMADJ_SU; oomadj <= OOM_ADJUST_MAX; oomadj++) {
+		if (score_to_oomadj(oomadj_to_score(oomadj)) != oomadj) {
+			PRT_TRACE_ERR("oom_adj %d does not survive oom_score_adj %d",
+				      oomadj, oomadj_to_score(oomadj));
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int proc_oom_fd(struct proc_oom *p)
+{
+	if (p->oomfd < 0)
+		p->oomfd = openat(p->dirfd, oom_file[oom_backend],
+				  O_RDWR | O_CLOEXEC);
+	return p->oomfd;
+}
 
-	char buf[PATH_MAX];
-	FILE *fp = NULL;
+static int proc_oom_read(struct proc_oom *p, int *oomadj)
+{
+	char buf[16];
+	int fd, len;
 
-	snprintf(buf, sizeof(buf), "/proc/%d/oom_adj", pid);
-	fp = fopen(buf, "r");
-	if (fp == NULL)
+	fd = proc_oom_fd(p);
+	if (fd < 0)
 		return -1;
-	if (fgets(buf, PATH_MAX, fp) == NULL) {
-		fclose(fp);
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0)
 		return -1;
+	buf[len] = '\0';
+
+	*oomadj = atoi(buf);
+	if (oom_backend == OOM_BACKEND_SCORE)
+		*oomadj = score_to_oomadj(*oomadj);
+	return 0;
+}
+
+static int proc_oom_write(struct proc_oom *p, int oomadj)
+{
+	char buf[16];
+	int fd, len;
+
+	fd = proc_oom_fd(p);
+	if (fd < 0)
+		return -1;
+	if (oom_backend == OOM_BACKEND_SCORE)
+		oomadj = oomadj_to_score(oomadj);
+	len = snprintf(buf, sizeof(buf), "%d", oomadj);
+	return pwrite(fd, buf, len, 0) == len ? 0 : -1;
+}
+
+static void proc_oom_free(struct proc_oom *p)
+{
+	if (p->oomfd >= 0)
+		close(p->oomfd);
+	close(p->dirfd);
+	free(p);
+}
+
+static void proc_oom_exit_cb(int pid, enum ss_proc_event event, void *data)
+{
+	ss_procmgr_forget_pid(pid);
+}
+
+static Eina_Bool proc_oom_lru_cb(const Eina_Hash *hash, const void *key,
+				void *data, void *fdata)
+{
+	struct proc_oom *p = data, **lru = fdata;
+
+	if (!p->bg && (*lru == NULL || (int)(p->used - (*lru)->used) < 0))
+		*lru = p;
+	return EINA_TRUE;
+}
+
+/* drop one entry to stay within PROC_OOM_MAX */
+static void proc_oom_evict(void)
+{
+	struct proc_oom *p = NULL;
+
+	eina_hash_foreach(proc_oom_hash, proc_oom_lru_cb, &p);
+	if (p == NULL && proc_oom_bg != NULL)
+		p = EINA_INLIST_CONTAINER_GET(proc_oom_bg->last,
+					      struct proc_oom);
+	if (p == NULL)
+		return;
+
+	PRT_TRACE("OOM table full, forgetting pid %d (oom_adj %d)", p->pid,
+		  p->oomadj);
+	ss_procmgr_forget_pid(p->pid);
+}
+
+/* table entry of a live pid, created from /proc on first contact */
+static struct proc_oom *proc_oom_get(int pid)
+{
+	struct proc_oom *p;
+	char buf[32];
+
+	p = eina_hash_find(proc_oom_hash, &pid);
+	if (p != NULL) {
+		p->used = ++proc_oom_tick;
+		return p;
+	}
+
+	if (eina_hash_population(proc_oom_hash) >= PROC_OOM_MAX)
+		proc_oom_evict();
+
+	p = malloc(sizeof(struct proc_oom));
+	if (p == NULL)
+		return NULL;
+
+	snprintf(buf, sizeof(buf), "/proc/%d", pid);
+	p->dirfd = open(buf, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (p->dirfd < 0) {
+		free(p);
+		return NULL;
+	}
+	p->oomfd = -1;
+	p->pid = pid;
+	p->bg = 0;
+	p->used = ++proc_oom_tick;
+	if (proc_oom_read(p, &p->oomadj) < 0 ||
+	    !eina_hash_add(proc_oom_hash, &p->pid, p)) {
+		proc_oom_free(p);
+		return NULL;
+	}
+	if (ss_proc_event_subscribe(pid, SS_PROC_EVENT_EXIT, proc_oom_exit_cb,
+				    NULL) < 0) {
+		eina_hash_del(proc_oom_hash, &p->pid, p);
+		proc_oom_free(p);
+		return NULL;
+	}
+	return p;
+}
+
+static void proc_oom_set(struct proc_oom *p, int oomadj)
+{
+	int bg = (oomadj >= OOMADJ_BACKGRD_UNLOCKED);
+
+	p->oomadj = oomadj;
+	if (bg && !p->bg) {
+		proc_oom_bg = eina_inlist_prepend(proc_oom_bg,
+						  EINA_INLIST_GET(p));
+		p->bg_since = ecore_time_get();
+	}
+	else if (!bg && p->bg)
+		proc_oom_bg = eina_inlist_remove(proc_oom_bg,
+						 EINA_INLIST_GET(p));
+	p->bg = bg;
+}
+
+/*
+ * Anyone may write the oom file behind our back, so lookups re-read it
+ * through the cached fd; a failed read means the pid is gone.
+ */
+static struct proc_oom *proc_oom_sync(int pid)
+{
+	struct proc_oom *p;
+	int oomadj;
+
+	p = proc_oom_get(pid);
+	if (p == NULL)
+		return NULL;
+	if (proc_oom_read(p, &oomadj) < 0) {
+		ss_procmgr_forget_pid(pid);
+		return NULL;
 	}
-	(*oomadj) = atoi(buf);
-	fclose(fp);
+	if (oomadj != p->oomadj)
+		proc_oom_set(p, oomadj);
+	return p;
+}
+
+/* the process is gone, drop what we know about it */
+void ss_procmgr_forget_pid(int pid)
+{
+	struct proc_oom *p;
+
+	p = eina_hash_find(proc_oom_hash, &pid);
+	if (p == NULL)
+		return;
+
+	if (p->bg)
+		proc_oom_bg = eina_inlist_remove(proc_oom_bg,
+						 EINA_INLIST_GET(p));
+	eina_hash_del(proc_oom_hash, &p->pid, p);
+	ss_proc_event_unsubscribe(pid, proc_oom_exit_cb, NULL);
+	proc_oom_free(p);
+}
+
+int get_app_oomadj(int pid, int *oomadj)
+{
+	struct proc_oom *p;
+
+	if (pid < 0)
+		return -1;
+
+	p = proc_oom_sync(pid);
+	if (p == NULL)
+		return -1;
+
+	(*oomadj) = p->oomadj;
 	return 0;
 }
 
 int set_app_oomadj(pid_t pid, int new_oomadj)
 {
-	char buf[PATH_MAX];
-	FILE *fp;
-	int old_oomadj;
+	struct proc_oom *p;
 	char exe_name[PATH_MAX];
 
 	if (sysman_get_cmdline_name(pid, exe_name, PATH_MAX) < 0)
 		snprintf(exe_name, sizeof(exe_name), "Unknown (maybe dead)");
 
-	snprintf(buf, sizeof(buf), "/proc/%d/oom_adj", pid);
-	fp = fopen(buf, "r");
-	if (fp == NULL)
-		return -1;
-	if (fgets(buf, PATH_MAX, fp) == NULL) {
-		fclose(fp);
+	p = proc_oom_sync(pid);
+	if (p == NULL)
 		return -1;
-	}
-	old_oomadj = atoi(buf);
-	fclose(fp);
 	PRT_TRACE_EM("Process %s, pid %d, old_oomadj %d", exe_name, pid,
-		     old_oomadj);
+		     p->oomadj);
 
-	if (old_oomadj < OOMADJ_APP_LIMIT)
+	if (p->oomadj < OOMADJ_APP_LIMIT)
 		return 0;
 
 	PRT_TRACE_EM("Process %s, pid %d, new_oomadj %d", exe_name, pid,
 		     new_oomadj);
-	snprintf(buf, sizeof(buf), "/proc/%d/oom_adj", pid);
-	fp = fopen(buf, "w");
-	if (fp == NULL)
+	if (proc_oom_write(p, new_oomadj) < 0) {
+		ss_procmgr_forget_pid(pid);
 		return -1;
-
-	fprintf(fp, "%d", new_oomadj);
-	fclose(fp);
+	}
+	proc_oom_set(p, new_oomadj);
 
 	return 0;
 }
 
+/* apply many oom_adj changes at once, returns how many took effect */
+int ss_procmgr_set_oom_batch(const struct ss_oom_update *upd, int n)
+{
+	struct proc_oom *p;
+	int i, done = 0;
+
+	for (i = 0; i < n; i++) {
+		p = proc_oom_get(upd[i].pid);
+		if (p == NULL)
+			continue;
+		if (p->oomadj != upd[i].oomadj &&
+		    proc_oom_write(p, upd[i].oomadj) < 0) {
+			ss_procmgr_forget_pid(upd[i].pid);
+			continue;
+		}
+		proc_oom_set(p, upd[i].oomadj);
+		done++;
+	}
+	return done;
+}
+
 int set_oomadj_action(int argc, char **argv)
 {
-	int pid = -1;
-	int new_oomadj = -20;
+	struct ss_oom_update upd;
 
 	if (argc < 2)
 		return -1;
-	if ((pid = atoi(argv[0])) < 0 || (new_oomadj = atoi(argv[1])) <= -20)
+	if ((upd.pid = atoi(argv[0])) < 0 || (upd.oomadj = atoi(argv[1])) <= -20)
 		return -1;
 
-	char buf[255];
-	FILE *fp;
+	PRT_TRACE_EM("OOMADJ_SET : pid %d, new_oomadj %d", upd.pid,
+		     upd.oomadj);
+	return ss_procmgr_set_oom_batch(&upd, 1) == 1 ? 0 : -1;
+}
+
+/* resident set size in kB, 0 if unknown */
+static unsigned int proc_rss_kb(struct proc_oom *p)
+{
+	char buf[64];
+	unsigned long size, rss;
+	int fd, len;
+
+	fd = openat(p->dirfd, "statm", O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return 0;
+	buf[len] = '\0';
+	if (sscanf(buf, "%lu %lu", &size, &rss) != 2)
+		return 0;
+	return rss * (getpagesize() / 1024);
+}
+
+struct bg_rank {
+	struct proc_oom *p;
+	double weight;
+};
 
-	PRT_TRACE_EM("OOMADJ_SET : pid %d, new_oomadj %d", pid, new_oomadj);
-	snprintf(buf, sizeof(buf), "/proc/%d/oom_adj", pid);
-	fp = fopen(buf, "w");
-	if (fp == NULL)
+static int bg_rank_cmp(const void *a, const void *b)
+{
+	const struct bg_rank *ra = a, *rb = b;
+
+	if (ra->weight < rb->weight)
 		return -1;
-	fprintf(fp, "%d", new_oomadj);
-	fclose(fp);
+	return ra->weight > rb->weight;
+}
 
-	return 0;
+/* background apps in the order they should be demoted, or NULL */
+static struct bg_rank *bg_rank_get(int *cnt)
+{
+	struct bg_rank *rank;
+	struct proc_oom *p;
+	double now = ecore_time_get();
+	int n = 0;
+
+	*cnt = eina_inlist_count(proc_oom_bg);
+	if (*cnt == 0)
+		return NULL;
+
+	rank = malloc(sizeof(struct bg_rank) * (*cnt));
+	if (rank == NULL)
+		return NULL;
+
+	EINA_INLIST_FOREACH(proc_oom_bg, p) {
+		rank[n].p = p;
+		rank[n].weight = n;
+		if (bg_policy == BG_POLICY_MEMORY)
+			rank[n].weight = (now - p->bg_since + 1) *
+			    proc_rss_kb(p);
+		n++;
+	}
+
+	if (bg_policy == BG_POLICY_MEMORY)
+		qsort(rank, n, sizeof(struct bg_rank), bg_rank_cmp);
+	return rank;
 }
 
+/* give every background app the oom_adj of its tier */
 int check_and_set_old_backgrd()
 {
-	int pid = -1;
-	DIR *dp;
-	struct dirent *dentry;
-	FILE *fp;
-	char buf[PATH_MAX];
-	int token =0;
-
-	dp = opendir("/proc");
-	if (!dp) {
-		PRT_TRACE_EM("BACKGRD MANAGE : fail to open /proc : %s", strerror(errno));
+	struct bg_rank *rank;
+	struct ss_oom_update *upd;
+	struct proc_oom *p;
+	int cnt, i, n = 0, tier = 0, left;
+
+	rank = bg_rank_get(&cnt);
+	if (rank == NULL)
+		return 0;
+	upd = malloc(cnt * sizeof(struct ss_oom_update));
+	if (upd == NULL) {
+		free(rank);
 		return -1;
 	}
 
-	while ((dentry = readdir(dp)) != NULL) {
-		if (!isdigit(dentry->d_name[0]))
-			continue;
-
-		pid = atoi(dentry->d_name);
+	left = bg_tiers[0].count;
+	for (i = 0; i < cnt; i++) {
+		p = rank[i].p;
+		while (tier < bg_tier_cnt && left == 0) {
+			if (++tier < bg_tier_cnt)
+				left = bg_tiers[tier].count;
+		}
 
-		snprintf(buf, sizeof(buf), "/proc/%d/oom_adj", pid);
-		fp = fopen(buf, "r");
-		if (fp == NULL)
-			continue;
-		if (fgets(buf, sizeof(buf), fp) == NULL) {
-			fclose(fp);
+		if (tier >= bg_tier_cnt) {
+			PRT_TRACE("BACKGRD MANAGE : kill the process %d (oom_adj %d)", p->pid, p->oomadj);
+			proc_kill_start(p->pid, PROC_KILL_AGING);
+			ss_procmgr_forget_pid(p->pid);
 			continue;
 		}
-		if(atoi(buf) == OOMADJ_BACKGRD_UNLOCKED) {
-			fclose(fp);
-			PRT_TRACE("BACKGRD MANAGE : process wchich has OOMADJ_BACKGRD_UNLOCKED exists");
+		left--;
+
+		if (p->oomadj == bg_tiers[tier].oomadj)
+			continue;
+		PRT_TRACE("BACKGRD MANAGE : process %d set oom_adj %d (before %d)", p->pid, bg_tiers[tier].oomadj, p->oomadj);
+		upd[n].pid = p->pid;
+		upd[n].oomadj = bg_tiers[tier].oomadj;
+		n++;
+	}
+	free(rank);
+
+	ss_procmgr_set_oom_batch(upd, n);
+	free(upd);
+	return 0;
+}
+
+/* the background apps in demotion order, for QUERY_SYSMAN_BG_LRU */
+int ss_procmgr_bg_lru(struct sysnoti_bg_app *apps, int max)
+{
+	struct bg_rank *rank;
+	double now = ecore_time_get();
+	int cnt, i;
+
+	rank = bg_rank_get(&cnt);
+	if (rank == NULL)
+		return 0;
+
+	for (i = 0; i < cnt && i < max; i++) {
+		apps[i].pid = rank[i].p->pid;
+		apps[i].oomadj = rank[i].p->oomadj;
+		apps[i].idle_ms = (now - rank[i].p->bg_since) * 1000;
+		apps[i].rss_kb = proc_rss_kb(rank[i].p);
+	}
+
+	free(rank);
+	return i;
+}
+
+static void bg_config_init(void)
+{
+	struct bg_tier tiers[BG_TIER_MAX];
+	char *buf;
+	int n = 0, used;
+
+	buf = getenv(BG_POLICY_ENV);
+	if (buf != NULL && !strcmp(buf, "memory"))
+		bg_policy = BG_POLICY_MEMORY;
+
+	buf = getenv(BG_TIERS_ENV);
+	if (buf == NULL)
+		return;
+
+	while (n < BG_TIER_MAX && sscanf(buf, "%d:%d%n", &tiers[n].count,
+					 &tiers[n].oomadj, &used) == 2) {
+		if (tiers[n].count < 0 ||
+		    tiers[n].oomadj < OOMADJ_BACKGRD_UNLOCKED)
 			break;
-		}
-		fclose(fp);
+		n++;
+		buf += used;
+		if (*buf != ',')
+			break;
+		buf++;
 	}
-	closedir(dp);
 
-	if(dentry != NULL ) {
-		int cur_oom=-1;
-		dp = opendir("/proc");
-		if (!dp) {
-			PRT_TRACE_EM("BACKGRD MANAGE : fail to open /proc : %s", strerror(errno));
-			return -1;
-		}
-		while ((dentry = readdir(dp)) != NULL) {
-
-			if (!isdigit(dentry->d_name[0]))
-				continue;
-
-			pid = atoi(dentry->d_name);
-
-			snprintf(buf, sizeof(buf), "/proc/%d/oom_adj", pid);
-			fp = fopen(buf, "r+");
-			if (fp == NULL)
-				continue;
-			if (fgets(buf, sizeof(buf), fp) == NULL) {
-				fclose(fp); 
-				continue;
-			}                          
-			cur_oom = atoi(buf);
-			if(cur_oom >= LIMITED_PROCESS_OOMADJ) {
-				PRT_TRACE("BACKGRD MANAGE : kill the process %d (oom_adj %d)", pid, cur_oom);
-				kill(pid, SIGTERM);
-			}
-			else if(cur_oom >= OOMADJ_BACKGRD_UNLOCKED) {
-				PRT_TRACE("BACKGRD MANAGE : process %d set oom_adj %d (before %d)", pid, cur_oom+1, cur_oom);
-				fprintf(fp, "%d", ++cur_oom);
-			}
-			fclose(fp);
-		}
-		closedir(dp);
+	if (n == 0 || *buf != '\0') {
+		PRT_TRACE_ERR("invalid %s, using the default tiers",
+			      BG_TIERS_ENV);
+		return;
+	}
+	memcpy(bg_tiers, tiers, sizeof(struct bg_tier) * n);
+	bg_tier_cnt = n;
+}
+
+/*
+ * On an OOM event apps are killed in rounds until MemAvailable is back
+ * above the target (SS_RECLAIM_TARGET_KB). Each round picks the most
+ * expendable apps, highest oom_adj first and the biggest within one
+ * oom_adj, until their resident size covers what is missing. The next
+ * round starts once every victim of the last one has exited.
+ */
+#define RECLAIM_TARGET_ENV	"SS_RECLAIM_TARGET_KB"
+#define RECLAIM_TARGET_KB	51200
+#define RECLAIM_MIN_OOMADJ	OOMADJ_BACKGRD_UNLOCKED	/* locked apps are kept */
+#define RECLAIM_BATCH_MAX	4	/* victims per round */
+#define RECLAIM_ROUNDS_MAX	5
+#define RECLAIM_SETTLE		0.05	/* seconds from the last exit to the next round */
+
+struct reclaim_victim {
+	struct proc_oom *p;
+	unsigned int rss_kb;
+};
+
+static unsigned int reclaim_target_kb = RECLAIM_TARGET_KB;
+static Ecore_Timer *reclaim_timer;
+static int reclaim_round_no;
+static int reclaim_pending;	/* victims of this round still alive */
+static double reclaim_started;
+
+static void reclaim_victim_gone(void);
+
+/*
+ * Low memory victims get SIGTERM and are followed until they exit. One
+ * that is still there after KILL_TERM_DEADLINE gets SIGKILL; one that
+ * survives that too (stuck in D state) is given up on after
+ * KILL_GIVEUP_DEADLINE. A pidfd taken before the first signal makes
+ * sure the escalation cannot hit a recycled pid.
+ */
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open		434
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal	424
+#endif
+
+#define KILL_TERM_DEADLINE	1.0	/* seconds */
+#define KILL_GIVEUP_DEADLINE	2.0
+
+struct proc_kill {
+	int pid;
+	int pidfd;		/* -1 without pidfd support */
+	int sig;		/* last signal sent */
+	enum proc_kill_kind kind;	/* RECLAIM is counted in reclaim_pending */
+	double sent;		/* ecore_time_get() of the SIGTERM */
+	Ecore_Timer *timer;
+};
+
+static Eina_List *proc_kills;
+static int proc_kills_oom;	/* OOM and reclaim victims in proc_kills */
+
+static int proc_kill_signal(struct proc_kill *k, int sig)
+{
+	k->sig = sig;
+	if (k->pidfd >= 0)
+		return syscall(SYS_pidfd_send_signal, k->pidfd, sig, NULL, 0);
+	return kill(k->pid, sig);
+}
+
+static void proc_kill_done(struct proc_kill *k, const char *how)
+{
+	PRT_TRACE_EM("KILL : %d %s %.1f ms after SIGTERM (last %s)", k->pid,
+		     how, (ecore_time_get() - k->sent) * 1000,
+		     k->sig == SIGKILL ? "SIGKILL" : "SIGTERM");
+
+	proc_kills = eina_list_remove(proc_kills, k);
+	if (k->kind != PROC_KILL_AGING)
+		proc_kills_oom--;
+	if (k->timer)
+		ecore_timer_del(k->timer);
+	if (k->pidfd >= 0)
+		close(k->pidfd);
+	if (k->kind == PROC_KILL_RECLAIM)
+		reclaim_victim_gone();
+	free(k);
+}
+
+static void proc_kill_exit_cb(int pid, enum ss_proc_event event, void *data)
+{
+	proc_kill_done(data, "exited");
+}
+
+static Eina_Bool proc_kill_timer_cb(void *data)
+{
+	struct proc_kill *k = data;
+
+	if (k->sig == SIGTERM) {
+		PRT_TRACE_EM("KILL : %d ignored SIGTERM, sending SIGKILL",
+			     k->pid);
+		proc_kill_signal(k, SIGKILL);
+		ecore_timer_interval_set(k->timer, KILL_GIVEUP_DEADLINE);
+		return EINA_TRUE;
+	}
+
+	k->timer = NULL;
+	ss_proc_event_unsubscribe(k->pid, proc_kill_exit_cb, k);
+	proc_kill_done(k, "still alive, giving up");
+	return EINA_FALSE;
+}
+
+/* SIGTERM in any case; returns 0 while the victim is followed, -1 if not */
+static int proc_kill_start(int pid, enum proc_kill_kind kind)
+{
+	struct proc_kill *k;
+
+	k = calloc(1, sizeof(struct proc_kill));
+	if (k == NULL) {
+		kill(pid, SIGTERM);
+		return -1;
 	}
+
+	k->pid = pid;
+	k->kind = kind;
+	k->pidfd = syscall(SYS_pidfd_open, pid, 0);
+	if (ss_proc_event_subscribe(pid, SS_PROC_EVENT_EXIT,
+				    proc_kill_exit_cb, k) < 0) {
+		/* exiting already, or no way to follow it: signal only */
+		proc_kill_signal(k, SIGTERM);
+		if (k->pidfd >= 0)
+			close(k->pidfd);
+		free(k);
+		return -1;
+	}
+
+	k->sent = ecore_time_get();
+	if (proc_kill_signal(k, SIGTERM) < 0) {
+		ss_proc_event_unsubscribe(pid, proc_kill_exit_cb, k);
+		if (k->pidfd >= 0)
+			close(k->pidfd);
+		free(k);
+		return -1;
+	}
+	k->timer = ecore_timer_add(KILL_TERM_DEADLINE, proc_kill_timer_cb, k);
+	proc_kills = eina_list_append(proc_kills, k);
+	if (kind != PROC_KILL_AGING)
+		proc_kills_oom++;
 	return 0;
 }
 
+int ss_procmgr_kill(int pid)
+{
+	return proc_kill_start(pid, PROC_KILL_OOM);
+}
+
+/* low memory victims that were signalled and have not exited yet */
+int ss_procmgr_kills_pending(void)
+{
+	return proc_kills_oom;
+}
+
+static int meminfo_available_kb(unsigned int *avail)
+{
+	char buf[1024];
+	unsigned long free_kb = 0, cached = 0, val;
+	char *p;
+	int fd, len;
+
+	fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return -1;
+	buf[len] = '\0';
+
+	p = strstr(buf, "MemAvailable:");
+	if (p != NULL && sscanf(p, "MemAvailable: %lu", &val) == 1) {
+		*avail = val;
+		return 0;
+	}
+
+	/* kernels before 3.14 */
+	p = strstr(buf, "MemFree:");
+	if (p != NULL)
+		sscanf(p, "MemFree: %lu", &free_kb);
+	p = strstr(buf, "\nCached:");
+	if (p != NULL)
+		sscanf(p, "\nCached: %lu", &cached);
+	*avail = free_kb + cached;
+	return 0;
+}
+
+static int reclaim_victim_cmp(const void *a, const void *b)
+{
+	const struct reclaim_victim *va = a, *vb = b;
+
+	if (va->p->oomadj != vb->p->oomadj)
+		return vb->p->oomadj - va->p->oomadj;
+	if (va->rss_kb != vb->rss_kb)
+		return va->rss_kb < vb->rss_kb ? 1 : -1;
+	return 0;
+}
+
+static Eina_Bool reclaim_collect_cb(const Eina_Hash *hash, const void *key,
+				    void *data, void *fdata)
+{
+	struct proc_oom *p = data;
+	Eina_List **list = fdata;
+
+	if (p->oomadj >= RECLAIM_MIN_OOMADJ)
+		*list = eina_list_append(*list, p);
+	return EINA_TRUE;
+}
+
+static struct reclaim_victim *reclaim_rank(int *cnt)
+{
+	struct reclaim_victim *rank;
+	Eina_List *list = NULL;
+	struct proc_oom *p;
+	int n = 0;
+
+	eina_hash_foreach(proc_oom_hash, reclaim_collect_cb, &list);
+	*cnt = eina_list_count(list);
+	if (*cnt == 0)
+		return NULL;
+
+	rank = malloc(sizeof(struct reclaim_victim) * (*cnt));
+	if (rank == NULL) {
+		eina_list_free(list);
+		return NULL;
+	}
+	EINA_LIST_FREE(list, p) {
+		rank[n].p = p;
+		rank[n].rss_kb = proc_rss_kb(p);
+		n++;
+	}
+	qsort(rank, n, sizeof(struct reclaim_victim), reclaim_victim_cmp);
+	return rank;
+}
+
+static void reclaim_stop(const char *why)
+{
+	unsigned int avail = 0;
+
+	meminfo_available_kb(&avail);
+	PRT_TRACE_EM("RECLAIM : %s after %d rounds, %.1f ms, avail %u kB",
+		     why, reclaim_round_no,
+		     (ecore_time_get() - reclaim_started) * 1000, avail);
+	reclaim_round_no = 0;
+}
+
+#define RECLAIM_TARGET_MET	(-1)
+
+/* one round, returns the number of victims or RECLAIM_TARGET_MET */
+static int reclaim_round(void)
+{
+	struct reclaim_victim *rank;
+	unsigned int avail, need, freed = 0;
+	double start = ecore_time_get();
+	char name[PATH_MAX];
+	int cnt, i;
+
+	if (meminfo_available_kb(&avail) < 0) {
+		reclaim_stop("no meminfo");
+		return 0;
+	}
+	if (avail >= reclaim_target_kb) {
+		reclaim_stop("target reached");
+		return RECLAIM_TARGET_MET;
+	}
+
+	rank = reclaim_rank(&cnt);
+	if (rank == NULL) {
+		reclaim_stop("no victims left");
+		return 0;
+	}
+
+	reclaim_round_no++;
+	need = reclaim_target_kb - avail;
+
+	/* the state that made us kill, named after the first victim */
+	if (sysman_get_cmdline_name(rank[0].p->pid, name, sizeof(name)) < 0)
+		snprintf(name, sizeof(name), "reclaim");
+	ss_memsnap_write(rank[0].p->pid, name);
+
+	for (i = 0; i < cnt && i < RECLAIM_BATCH_MAX && freed < need; i++) {
+		PRT_TRACE_EM("RECLAIM : kill %d (oom_adj %d, %u kB)",
+			     rank[i].p->pid, rank[i].p->oomadj,
+			     rank[i].rss_kb);
+		if (proc_kill_start(rank[i].p->pid, PROC_KILL_RECLAIM) == 0)
+			reclaim_pending++;
+		freed += rank[i].rss_kb;
+		ss_procmgr_forget_pid(rank[i].p->pid);
+	}
+	free(rank);
+
+	PRT_TRACE_EM("RECLAIM : round %d, avail %u kB, target %u kB, "
+		     "%d killed (~%u kB) in %.1f ms", reclaim_round_no, avail,
+		     reclaim_target_kb, i, freed,
+		     (ecore_time_get() - start) * 1000);
+
+	/* nothing to wait for, go on right away */
+	if (reclaim_pending == 0)
+		reclaim_victim_gone();
+	return i;
+}
+
+static Eina_Bool reclaim_next_cb(void *data)
+{
+	reclaim_timer = NULL;
+	if (reclaim_round_no >= RECLAIM_ROUNDS_MAX)
+		reclaim_stop("round limit");
+	else
+		reclaim_round();
+	return EINA_FALSE;
+}
+
+static void reclaim_victim_gone(void)
+{
+	if (reclaim_pending > 0)
+		reclaim_pending--;
+	if (reclaim_pending > 0 || reclaim_round_no == 0 ||
+	    reclaim_timer != NULL)
+		return;
+	reclaim_timer = ecore_timer_add(RECLAIM_SETTLE, reclaim_next_cb, NULL);
+}
+
+/*
+ * Starts a reclaim unless one is running. Returns 0 while reclaiming,
+ * 1 when MemAvailable already meets the target and -1 when there was
+ * nothing to kill, so that the caller can fall back to its own victim.
+ */
+int ss_procmgr_reclaim(void)
+{
+	int ret;
+
+	if (reclaim_round_no > 0)
+		return 0;
+
+	reclaim_started = ecore_time_get();
+	ret = reclaim_round();
+	if (ret == RECLAIM_TARGET_MET)
+		return 1;
+	if (ret == 0)
+		return -1;
+	return 0;
+}
+
+static void reclaim_config_init(void)
+{
+	char *buf;
+
+	buf = getenv(RECLAIM_TARGET_ENV);
+	if (buf != NULL && atoi(buf) > 0)
+		reclaim_target_kb = atoi(buf);
+}
+
 int set_active_action(int argc, char **argv)
 {
 	int pid = -1;
@@ -253,12 +1002,9 @@ int set_inactive_action(int argc, char **argv)
 		ret = set_app_oomadj((pid_t) pid, OOMADJ_FOREGRD_UNLOCKED);
 		break;
 	case OOMADJ_BACKGRD_LOCKED:
-		check_and_set_old_backgrd();
-		ret = set_app_oomadj((pid_t) pid, OOMADJ_BACKGRD_UNLOCKED);
-		break;
 	case OOMADJ_INIT:
-		check_and_set_old_backgrd();
 		ret = set_app_oomadj((pid_t) pid, OOMADJ_BACKGRD_UNLOCKED);
+		check_and_set_old_backgrd();
 		break;
 	default:
 		if(oomadj > OOMADJ_BACKGRD_UNLOCKED) {
@@ -339,12 +1085,9 @@ int set_backgrd_action(int argc, char **argv)
 		ret = set_app_oomadj((pid_t) pid, OOMADJ_BACKGRD_LOCKED);
 		break;
 	case OOMADJ_FOREGRD_UNLOCKED:
-		check_and_set_old_backgrd();
-		ret = set_app_oomadj((pid_t) pid, OOMADJ_BACKGRD_UNLOCKED);
-		break;
 	case OOMADJ_INIT:
-		check_and_set_old_backgrd();
 		ret = set_app_oomadj((pid_t) pid, OOMADJ_BACKGRD_UNLOCKED);
+		check_and_set_old_backgrd();
 		break;
 	default:
 		if(oomadj > OOMADJ_BACKGRD_UNLOCKED) {
@@ -360,6 +1103,16 @@ int set_backgrd_action(int argc, char **argv)
 
 int ss_process_manager_init(void)
 {
+	proc_oom_hash = eina_hash_int32_new(NULL);
+	if (proc_oom_hash == NULL)
+		PRT_TRACE_ERR("oom table init failed");
+	bg_config_init();
+	reclaim_config_init();
+	if (access("/proc/self/oom_score_adj", W_OK) == 0 &&
+	    oom_convert_check() == 0)
+		oom_backend = OOM_BACKEND_SCORE;
+	PRT_TRACE("oom backend : %s", oom_file[oom_backend]);
+
 	ss_action_entry_add_internal(PREDEF_FOREGRD, set_foregrd_action, NULL,
 				     NULL);
 	ss_action_entry_add_internal(PREDEF_BACKGRD, set_backgrd_action, NULL,
@@ -18,9 +18,22 @@
 #ifndef __SS_PROCMGR_H__
 #define __SS_PROCMGR_H__
 
+#include "include/ss_sysnoti_proto.h"
+
+struct ss_oom_update {
+	int pid;
+	int oomadj;	/* OOMADJ_* units, converted for oom_score_adj */
+};
+
 int ss_process_manager_init(void);
 
 int get_app_oomadj(int pid, int *oomadj);
 int set_app_oomadj(int pid, int new_oomadj);
+int ss_procmgr_set_oom_batch(const struct ss_oom_update *upd, int n);
+void ss_procmgr_forget_pid(int pid);
+int ss_procmgr_reclaim(void);
+int ss_procmgr_kill(int pid);
+int ss_procmgr_kills_pending(void);
+int ss_procmgr_bg_lru(struct sysnoti_bg_app *apps, int max);
 
 #endif /* __SS_PROCMGR_H__ */
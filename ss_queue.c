@@ -21,26 +21,278 @@
 #include "ss_core.h"
 #include "ss_queue.h"
 #include "ss_log.h"
+#include "ss_watchdog.h"
 
 #define SS_PREDEFINE_ACT_FUNC_STR		"ss_predefine_action"
 #define SS_IS_ACCESSABLE_FUNC_STR		"ss_is_accessable"
 #define SS_UI_VIEWABLE_FUNC_STR			"ss_ui_viewable"
+#define SS_IDLE_UNLOAD_SYM_STR			"ss_idle_unload"
+#define SS_ACTION_TIMEOUT_SYM_STR		"ss_action_timeout"
+#define SS_THREAD_SAFE_SYM_STR			"ss_thread_safe"
 
-static Eina_List *predef_act_list;
-static Eina_List *run_queue;
+/*
+ * Plugins are registered by path only and dlopen()ed by the first call.
+ * A plugin that exports SS_IDLE_UNLOAD_SYM_STR and has had no queued
+ * entry for SS_PLUGIN_IDLE_TIMEOUT seconds (0 keeps everything loaded)
+ * is dlclose()d again. Other plugins may keep threads, callbacks or
+ * state alive past their calls, so they stay loaded once opened.
+ *
+ * A plugin whose action returns the pid of a short-lived child may
+ * export "int ss_action_timeout", in seconds, to have that child
+ * watched and killed once it runs longer.
+ *
+ * A plugin that exports SS_THREAD_SAFE_SYM_STR runs on SS_LANE_PLUGIN,
+ * off the main loop, all others run inline on it.
+ */
+#define SS_PLUGIN_IDLE_TIMEOUT		60
+#define SS_PLUGIN_IDLE_ENV		"SS_PLUGIN_IDLE_TIMEOUT"
+
+static Ecore_Timer *plugin_idle_timer;
+static double plugin_idle_timeout = SS_PLUGIN_IDLE_TIMEOUT;
+static int plugins_loaded;
+
+struct plugin_idle_scan {
+	double now;
+	int left;		/* opted-in plugins still loaded */
+};
+
+/* action registry, keyed by the interned (stringshare) action name */
+static Eina_Hash *predef_act_hash;
+/* built-in actions, indexed by enum ss_action_id */
+static struct ss_action_entry *builtin_act[SS_ACTION_ID_MAX];
+
+/* run queue entries, one list per state plus an index on forked_pid */
+static Eina_Inlist *run_queue[SS_STATE_MAX];
+static Eina_Hash *run_queue_pid_hash;
+static Eina_Inlist *run_queue_init[SS_PRIO_MAX];
+static int run_queue_promoted;
+static int run_queue_depth[SS_STATE_MAX];
+static int run_queue_peak[SS_STATE_MAX];
+
+/*
+ * Retired entries go back to a free pool instead of the heap. The pool is
+ * refilled a slab at a time and never shrinks, so its size follows the
+ * deepest queue seen so far.
+ */
+#define SS_RQ_SLAB_ENTRIES	16
+
+static Eina_Inlist *run_queue_pool;
+static struct ss_run_queue_alloc_stats rq_alloc_stats;
+
+static const char *builtin_act_name[SS_ACTION_ID_MAX] = {
+	[SS_ACTION_LOWMEM] = PREDEF_LOWMEM,
+	[SS_ACTION_LOWBAT] = PREDEF_LOWBAT,
+	[SS_ACTION_USBCON] = PREDEF_USBCON,
+	[SS_ACTION_EARJACKCON] = PREDEF_EARJACKCON,
+	[SS_ACTION_POWEROFF] = PREDEF_POWEROFF,
+	[SS_ACTION_PWROFF_POPUP] = PREDEF_PWROFF_POPUP,
+	[SS_ACTION_REBOOT] = PREDEF_REBOOT,
+	[SS_ACTION_FOREGRD] = PREDEF_FOREGRD,
+	[SS_ACTION_BACKGRD] = PREDEF_BACKGRD,
+	[SS_ACTION_ACTIVE] = PREDEF_ACTIVE,
+	[SS_ACTION_INACTIVE] = PREDEF_INACTIVE,
+	[SS_ACTION_OOMADJ_SET] = OOMADJ_SET,
+	[SS_ACTION_SET_DATETIME] = PREDEF_SET_DATETIME,
+	[SS_ACTION_SET_TIMEZONE] = PREDEF_SET_TIMEZONE,
+	[SS_ACTION_MOUNT_MMC] = PREDEF_MOUNT_MMC,
+	[SS_ACTION_UNMOUNT_MMC] = PREDEF_UNMOUNT_MMC,
+	[SS_ACTION_FORMAT_MMC] = PREDEF_FORMAT_MMC,
+	[SS_ACTION_SET_MAX_FREQUENCY] = PREDEF_SET_MAX_FREQUENCY,
+	[SS_ACTION_SET_MIN_FREQUENCY] = PREDEF_SET_MIN_FREQUENCY,
+	[SS_ACTION_RELEASE_MAX_FREQUENCY] = PREDEF_RELEASE_MAX_FREQUENCY,
+	[SS_ACTION_RELEASE_MIN_FREQUENCY] = PREDEF_RELEASE_MIN_FREQUENCY,
+	[SS_ACTION_USB_STORAGE_ADD] = PREDEF_USB_STORAGE_ADD,
+	[SS_ACTION_USB_STORAGE_REMOVE] = PREDEF_USB_STORAGE_REMOVE,
+};
+
+struct ss_action_entry *ss_action_entry_find(const char *type)
+{
+	if (predef_act_hash == NULL || type == NULL)
+		return NULL;
+
+	return eina_hash_find(predef_act_hash, type);
+}
 
-static struct ss_action_entry *ss_action_entry_find(char *type)
+/* built-in actions are registered with an empty path */
+#define IS_PLUGIN(data)		((data)->path[0] != '\0')
+
+static void ss_action_entry_unload(struct ss_action_entry *data)
+{
+	dlclose(data->handle);
+	data->handle = NULL;
+	data->predefine_action = NULL;
+	data->is_accessable = NULL;
+	data->ui_viewable = NULL;
+	plugins_loaded--;
+	PRT_TRACE("[SYSMAN] plugin unloaded - %s", data->type);
+}
+
+static void ss_action_entry_free(struct ss_action_entry *data)
+{
+	PRT_TRACE("[SYSMAN] plugin removed - %s", data->type);
+	if (data->handle)
+		ss_action_entry_unload(data);
+	eina_stringshare_del(data->type);
+	free(data->path);
+	free(data);
+}
+
+/* the last run queue entry of a plugin retired */
+static void ss_action_entry_idle(struct ss_action_entry *data)
+{
+	if (data->removed) {
+		ss_action_entry_free(data);
+		return;
+	}
+	if (data->stale) {
+		data->stale = 0;
+		if (data->handle)
+			ss_action_entry_unload(data);
+	}
+}
+
+/*
+ * The library of a plugin was replaced on disk: drop the loaded copy so
+ * that the next call loads the new one. Entries still running keep the
+ * old copy until they have all retired.
+ */
+int ss_action_entry_reload(const char *type)
+{
+	struct ss_action_entry *data;
+
+	data = ss_action_entry_find(type);
+	if (data == NULL || !IS_PLUGIN(data))
+		return -1;
+
+	data->stale = 1;
+	if (data->users == 0)
+		ss_action_entry_idle(data);
+	return 0;
+}
+
+/* unregister a plugin, it is freed once none of its entries is left */
+int ss_action_entry_del(const char *type)
 {
-	Eina_List *tmp;
-	Eina_List *tmp_next;
 	struct ss_action_entry *data;
 
-	EINA_LIST_FOREACH_SAFE(predef_act_list, tmp, tmp_next, data) {
-		if ((data != NULL) && (!strcmp(data->type, type)))
-			return data;
+	data = ss_action_entry_find(type);
+	if (data == NULL || !IS_PLUGIN(data))
+		return -1;
+
+	eina_hash_del(predef_act_hash, data->type, data);
+	data->removed = 1;
+	if (data->users == 0)
+		ss_action_entry_idle(data);
+	return 0;
+}
+
+static Eina_Bool plugin_idle_cb(const Eina_Hash *hash, const void *key,
+				void *hdata, void *fdata)
+{
+	struct ss_action_entry *data = hdata;
+	struct plugin_idle_scan *scan = fdata;
+
+	if (data->handle == NULL || !data->idle_unload)
+		return EINA_TRUE;
+	if (data->users == 0 &&
+	    scan->now - data->last_used >= plugin_idle_timeout)
+		ss_action_entry_unload(data);
+	else
+		scan->left++;
+	return EINA_TRUE;
+}
+
+static Eina_Bool plugin_idle_timer_cb(void *data)
+{
+	struct plugin_idle_scan scan = { ecore_time_get(), 0 };
+
+	eina_hash_foreach(predef_act_hash, plugin_idle_cb, &scan);
+	if (scan.left == 0) {
+		plugin_idle_timer = NULL;
+		return EINA_FALSE;
 	}
+	return EINA_TRUE;
+}
 
-	return NULL;
+/* make sure a plugin is loaded before it is called */
+static int ss_action_entry_load(struct ss_action_entry *data)
+{
+	void *handle;
+	int *timeout;
+
+	if (data->handle || !IS_PLUGIN(data))
+		return 0;
+
+	handle = dlopen(data->path, RTLD_LAZY);
+	if (!handle) {
+		PRT_TRACE_ERR("cannot load %s : %s", data->path, dlerror());
+		return -1;
+	}
+
+	data->predefine_action = dlsym(handle, SS_PREDEFINE_ACT_FUNC_STR);
+	if (data->predefine_action == NULL) {
+		PRT_TRACE_ERR("cannot find predefine_action symbol : %s",
+			      SS_PREDEFINE_ACT_FUNC_STR);
+		dlclose(handle);
+		return -1;
+	}
+
+	data->is_accessable = dlsym(handle, SS_IS_ACCESSABLE_FUNC_STR);
+	data->ui_viewable = dlsym(handle, SS_UI_VIEWABLE_FUNC_STR);
+	data->idle_unload = dlsym(handle, SS_IDLE_UNLOAD_SYM_STR) != NULL;
+	data->lane = dlsym(handle, SS_THREAD_SAFE_SYM_STR) != NULL ?
+	    SS_LANE_PLUGIN : SS_LANE_MAIN;
+	timeout = dlsym(handle, SS_ACTION_TIMEOUT_SYM_STR);
+	if (timeout != NULL && *timeout > 0)
+		data->timeout = *timeout;
+	data->handle = handle;
+	data->last_used = ecore_time_get();
+	plugins_loaded++;
+	PRT_TRACE("[SYSMAN] plugin loaded - %s", data->type);
+
+	if (data->idle_unload && plugin_idle_timeout > 0 &&
+	    plugin_idle_timer == NULL)
+		plugin_idle_timer = ecore_timer_add(plugin_idle_timeout / 2,
+						    plugin_idle_timer_cb, NULL);
+	return 0;
+}
+
+int ss_action_entry_plugins_loaded(void)
+{
+	return plugins_loaded;
+}
+
+static int ss_action_entry_register(struct ss_action_entry *data)
+{
+	int i;
+
+	data->id = -1;
+	data->lane = SS_LANE_MAIN;
+	data->prio = IS_PLUGIN(data) ? SS_PRIO_BACKGROUND : SS_PRIO_INTERACTIVE;
+	data->timeout = 0;
+	data->users = 0;
+	data->last_used = 0;
+	data->idle_unload = 0;
+	data->stale = 0;
+	data->removed = 0;
+	memset(&data->stats, 0, sizeof(data->stats));
+	strncpy(data->stats.type, data->type, SYSNOTI_STATS_TYPE_LEN - 1);
+	for (i = 0; i < SS_ACTION_ID_MAX; i++) {
+		if (builtin_act_name[i] && !strcmp(builtin_act_name[i],
+						   data->type)) {
+			data->id = i;
+			break;
+		}
+	}
+
+	if (!eina_hash_direct_add(predef_act_hash, data->type, data))
+		return -1;
+
+	/* a plugin may not take over the id of a built-in action */
+	if (data->id >= 0 && !IS_PLUGIN(data))
+		builtin_act[data->id] = data;
+
+	return 0;
 }
 
 int ss_action_entry_add_internal(char *type,
@@ -69,22 +321,114 @@ int ss_action_entry_add_internal(char *type,
 	data->is_accessable = is_accessable;
 	data->ui_viewable = ui_viewable;
 	data->owner_pid = getpid();
-	data->type = strdup(type);
+	data->type = (char *)eina_stringshare_add(type);
 	data->path = strdup("");
 
-	predef_act_list = eina_list_prepend(predef_act_list, data);
+	if (ss_action_entry_register(data) < 0) {
+		eina_stringshare_del(data->type);
+		free(data->path);
+		goto err;
+	}
 
-	PRT_TRACE_ERR("[SYSMAN] add predefine action entry suceessfully - %s",
+	PRT_TRACE("[SYSMAN] add predefine action entry successfully - %s",
 		  data->type);
 	return 0;
  err:
-	if (data->type != NULL)
-		PRT_TRACE_ERR("[SYSMAN] add predefine action entry -%s",
-			      data->type);
+	PRT_TRACE_ERR("[SYSMAN] FAIL predefine action entry - %s", type);
 	free(data);
 	return -1;
 }
 
+int ss_action_entry_set_lane(char *type, enum ss_action_lane lane)
+{
+	struct ss_action_entry *data;
+
+	if (lane < SS_LANE_MAIN || lane >= SS_LANE_MAX)
+		return -1;
+
+	data = ss_action_entry_find(type);
+	if (data == NULL)
+		return -1;
+
+	data->lane = lane;
+	return 0;
+}
+
+int ss_action_entry_set_prio(char *type, enum ss_action_prio prio)
+{
+	struct ss_action_entry *data;
+
+	if (prio < SS_PRIO_CRITICAL || prio >= SS_PRIO_MAX)
+		return -1;
+
+	data = ss_action_entry_find(type);
+	if (data == NULL)
+		return -1;
+
+	data->prio = prio;
+	return 0;
+}
+
+int ss_action_entry_set_timeout(char *type, double timeout)
+{
+	struct ss_action_entry *data;
+
+	data = ss_action_entry_find(type);
+	if (data == NULL)
+		return -1;
+
+	data->timeout = timeout;
+	return 0;
+}
+
+/* add one sample to a log2 usec histogram, a wait sample counts a call */
+void ss_action_entry_account(struct ss_action_entry *data,
+			     enum sysnoti_hist hist, double sec)
+{
+	unsigned int usec;
+	int b = 0;
+
+	if (sec < 0)
+		sec = 0;
+	usec = sec >= 4000.0 ? 0xffffffff : (unsigned int)(sec * 1000000);
+	if (usec > 1)
+		b = 31 - __builtin_clz(usec);
+	if (b >= SYSNOTI_HIST_BUCKETS)
+		b = SYSNOTI_HIST_BUCKETS - 1;
+
+	data->stats.hist[hist][b]++;
+	if (hist == SYSNOTI_HIST_WAIT)
+		data->stats.calls++;
+}
+
+int ss_action_entry_count(void)
+{
+	return eina_hash_population(predef_act_hash);
+}
+
+struct action_foreach {
+	int (*func) (struct ss_action_entry *, void *);
+	void *user_data;
+};
+
+static Eina_Bool ss_action_entry_foreach_cb(const Eina_Hash *hash,
+					    const void *key, void *data,
+					    void *fdata)
+{
+	struct action_foreach *fe = fdata;
+
+	return fe->func(data, fe->user_data) == 0;
+}
+
+/* func returns non-zero to stop */
+void ss_action_entry_foreach(int (*func) (struct ss_action_entry *, void *),
+			     void *user_data)
+{
+	struct action_foreach fe = { func, user_data };
+
+	eina_hash_foreach(predef_act_hash, ss_action_entry_foreach_cb, &fe);
+}
+
 int ss_action_entry_add(struct sysnoti *msg)
 {
 	struct ss_action_entry *data;
@@ -96,31 +440,31 @@ int ss_action_entry_add(struct sysnoti *msg)
 		return -1;
 	}
 
+	data->handle = NULL;
 	if (ss_action_entry_find(msg->type) != NULL)
 		goto err;
 
-	data->handle = dlopen(msg->path, RTLD_LAZY);
-	if (!data->handle) {
+	/* the library is only loaded by the first call */
+	if (msg->path == NULL || msg->path[0] == '\0' ||
+	    access(msg->path, R_OK) != 0) {
 		PRT_TRACE_ERR("cannot find such library");
 		goto err;
 	}
 
-	data->predefine_action = dlsym(data->handle, SS_PREDEFINE_ACT_FUNC_STR);
-	if (data->predefine_action == NULL) {
-		PRT_TRACE_ERR("cannot find predefine_action symbol : %s",
-			      SS_PREDEFINE_ACT_FUNC_STR);
-		goto err;
-	}
-
-	data->is_accessable = dlsym(data->handle, SS_IS_ACCESSABLE_FUNC_STR);
-	data->ui_viewable = dlsym(data->handle, SS_UI_VIEWABLE_FUNC_STR);
+	data->predefine_action = NULL;
+	data->is_accessable = NULL;
+	data->ui_viewable = NULL;
 	data->owner_pid = msg->pid;
-	data->type = strdup(msg->type);
+	data->type = (char *)eina_stringshare_add(msg->type);
 	data->path = strdup(msg->path);
 
-	predef_act_list = eina_list_prepend(predef_act_list, data);
+	if (ss_action_entry_register(data) < 0) {
+		eina_stringshare_del(data->type);
+		free(data->path);
+		goto err;
+	}
 
-	PRT_TRACE_ERR("[SYSMAN]add predefine action entry suceessfully - %s",
+	PRT_TRACE("[SYSMAN] add predefine action entry successfully - %s",
 		  data->type);
 	return 0;
  err:
@@ -129,173 +473,542 @@ int ss_action_entry_add(struct sysnoti *msg)
 	return -1;
 }
 
+static struct ss_run_queue_entry *__ss_run_queue_add(struct ss_action_entry
+						     *act_entry,
+						     enum ss_action_prio prio,
+						     int argc, char **argv);
+
+static int __ss_action_entry_call_internal(struct ss_action_entry *data,
+					   enum ss_action_prio prio,
+					   int argc, va_list argptr)
+{
+	int i;
+	char *argv[SYSMAN_MAXARG];
+
+	for (i = 0; i < argc; i++)
+		argv[i] = va_arg(argptr, char *);
+
+	if (__ss_run_queue_add(data, prio, argc, argv) == NULL) {
+		PRT_TRACE_ERR("cannot queue %s", data->type);
+		return -1;
+	}
+
+	/* a full core ring is rescanned on the next drain, still queued */
+	if (ss_core_action_run() < 0)
+		PRT_TRACE("core ring full, %s runs on the next drain",
+			  data->type);
+	return 0;
+}
+
 int ss_action_entry_call_internal(char *type, int argc, ...)
 {
-	Eina_List *tmp;
-	Eina_List *tmp_next;
 	struct ss_action_entry *data;
 	va_list argptr;
-	int i;
-	char *args = NULL;
-	char *argv[SYSMAN_MAXARG];
+	int ret;
 
 	if (argc > SYSMAN_MAXARG || type == NULL)
 		return -1;
 
-	EINA_LIST_FOREACH_SAFE(predef_act_list, tmp, tmp_next, data) {
-		if ((data != NULL) && (!strcmp(data->type, type))) {
-			va_start(argptr, argc);
-			for (i = 0; i < argc; i++) {
-				args = va_arg(argptr, char *);
-				if (args != NULL)
-					argv[i] = strdup(args);
-				else
-					argv[i] = NULL;
-			}
-			va_end(argptr);
-
-			int ret;
-			ret=ss_run_queue_add(data, argc, argv);
-			PRT_TRACE_ERR("ss_run_queue_add : %d",ret);
-			ret=ss_core_action_run();
-			PRT_TRACE_ERR("ss_core_action_run : %d",ret);
-			return 0;
-		}
+	data = ss_action_entry_find(type);
+	if (data == NULL)
+		return 0;
+
+	va_start(argptr, argc);
+	ret = __ss_action_entry_call_internal(data, data->prio, argc, argptr);
+	va_end(argptr);
+	return ret;
+}
+
+int ss_action_entry_call_internal_id(enum ss_action_id id, int argc, ...)
+{
+	struct ss_action_entry *data;
+	va_list argptr;
+	int ret;
+
+	if (argc > SYSMAN_MAXARG || id < 0 || id >= SS_ACTION_ID_MAX)
+		return -1;
+
+	data = builtin_act[id];
+	if (data == NULL)
+		return 0;
+
+	va_start(argptr, argc);
+	ret = __ss_action_entry_call_internal(data, data->prio, argc, argptr);
+	va_end(argptr);
+	return ret;
+}
+
+/* same as ss_action_entry_call_internal_id() but in the given class */
+int ss_action_entry_call_internal_prio(enum ss_action_id id,
+				       enum ss_action_prio prio, int argc, ...)
+{
+	struct ss_action_entry *data;
+	va_list argptr;
+	int ret;
+
+	if (argc > SYSMAN_MAXARG || id < 0 || id >= SS_ACTION_ID_MAX)
+		return -1;
+	if (prio < SS_PRIO_CRITICAL || prio >= SS_PRIO_MAX)
+		return -1;
+
+	data = builtin_act[id];
+	if (data == NULL)
+		return 0;
+
+	va_start(argptr, argc);
+	ret = __ss_action_entry_call_internal(data, prio, argc, argptr);
+	va_end(argptr);
+	return ret;
+}
+
+static struct ss_run_queue_entry *ss_action_entry_queue(struct sysnoti *msg,
+				int argc, char **argv,
+				void (*done) (struct ss_run_queue_entry *,
+					      void *), void *done_data)
+{
+	struct ss_run_queue_entry *rq_entry;
+
+	struct ss_action_entry *data;
+
+	if (argc > SYSMAN_MAXARG || msg->type == NULL)
+		return NULL;
+
+	data = ss_action_entry_find(msg->type);
+	if (data == NULL) {
+		PRT_TRACE_EM("[SYSMAN] cannot found action");
+		return NULL;
 	}
 
-	return 0;
+	if (ss_action_entry_load(data) < 0)
+		return NULL;
+
+	if (data->is_accessable != NULL
+	    && data->is_accessable(msg->pid) == 0) {
+		PRT_TRACE_ERR("%d cannot call that predefine module",
+			      msg->pid);
+		return NULL;
+	}
+
+	rq_entry = __ss_run_queue_add(data, data->prio, argc, argv);
+	if (rq_entry == NULL)
+		return NULL;
+	rq_entry->done = done;
+	rq_entry->done_data = done_data;
+	return rq_entry;
 }
 
 int ss_action_entry_call(struct sysnoti *msg, int argc, char **argv)
 {
-	Eina_List *tmp;
-	Eina_List *tmp_next;
-	struct ss_action_entry *data;
+	return ss_action_entry_call_notify(msg, argc, argv, NULL, NULL);
+}
 
-	EINA_LIST_FOREACH_SAFE(predef_act_list, tmp, tmp_next, data) {
-		if ((data != NULL) && (!strcmp(data->type, msg->type))) {
-			if (data->is_accessable != NULL
-			    && data->is_accessable(msg->pid) == 0) {
-				PRT_TRACE_ERR
-				    ("%d cannot call that predefine module",
-				     msg->pid);
-				return -1;
-			}
-			int ret;
-			ret=ss_run_queue_add(data, argc, argv);
-			PRT_TRACE_ERR("ss_run_queue_add : %d",ret);
-			ret=ss_core_action_run();
-			PRT_TRACE_ERR("ss_core_action_run : %d",ret);
-			return 0;
-		}
+int ss_action_entry_call_notify(struct sysnoti *msg, int argc, char **argv,
+				void (*done) (struct ss_run_queue_entry *,
+					      void *), void *done_data)
+{
+	if (ss_action_entry_queue(msg, argc, argv, done, done_data) == NULL)
+		return -1;
+
+	if (ss_core_action_run() < 0)
+		PRT_TRACE("core ring full, %s runs on the next drain",
+			  msg->type);
+	return 0;
+}
+
+/* queued entries are kept apart by class, the other states in one list */
+static Eina_Inlist **ss_run_queue_list(struct ss_run_queue_entry *rq_entry)
+{
+	if (rq_entry->state == SS_STATE_INIT)
+		return &run_queue_init[rq_entry->prio];
+	return &run_queue[rq_entry->state];
+}
+
+static void ss_run_queue_link(struct ss_run_queue_entry *rq_entry)
+{
+	enum ss_run_state state = rq_entry->state;
+	Eina_Inlist **list = ss_run_queue_list(rq_entry);
+
+	/* append keeps call order, a batch runs in the order it was sent */
+	*list = eina_inlist_append(*list, EINA_INLIST_GET(rq_entry));
+	run_queue_depth[state]++;
+	if (run_queue_depth[state] > run_queue_peak[state])
+		run_queue_peak[state] = run_queue_depth[state];
+}
+
+static void ss_run_queue_unlink(struct ss_run_queue_entry *rq_entry)
+{
+	enum ss_run_state state = rq_entry->state;
+	Eina_Inlist **list = ss_run_queue_list(rq_entry);
+
+	*list = eina_inlist_remove(*list, EINA_INLIST_GET(rq_entry));
+	run_queue_depth[state]--;
+}
+
+int ss_action_entry_call_batch(struct sysnoti *msgs, int n, int *results)
+{
+	struct ss_run_queue_entry *batch[SYSNOTI_V2_MAX_BATCH];
+	enum ss_action_prio prio = SS_PRIO_MAX;
+	int i;
+	int queued = 0;
+
+	if (n > SYSNOTI_V2_MAX_BATCH)
+		n = SYSNOTI_V2_MAX_BATCH;
+
+	for (i = 0; i < n; i++) {
+		batch[queued] = ss_action_entry_queue(&msgs[i], msgs[i].argc,
+						      msgs[i].argv, NULL, NULL);
+		results[i] = batch[queued] ? 0 : -1;
+		if (batch[queued] == NULL)
+			continue;
+		if (batch[queued]->prio < prio)
+			prio = batch[queued]->prio;
+		queued++;
 	}
 
-	PRT_TRACE_EM("[SYSMAN] cannot found action");
-	return -1;
+	/*
+	 * Requeue the whole batch, in record order, in the class of its
+	 * most urgent record. It is exempt from the run budget, so one
+	 * pass dispatches all of it.
+	 */
+	for (i = 0; i < queued; i++) {
+		ss_run_queue_unlink(batch[i]);
+		batch[i]->prio = prio;
+		batch[i]->base_prio = prio;
+		batch[i]->batch = 1;
+		ss_run_queue_link(batch[i]);
+	}
+
+	/* one core wakeup dispatches the whole batch */
+	if (queued > 0)
+		ss_core_action_run();
+
+	PRT_TRACE_EM("[SYSMAN] batch of %d actions, %d queued", n, queued);
+	return queued;
 }
 
-int ss_run_queue_add(struct ss_action_entry *act_entry, int argc, char **argv)
+static struct ss_run_queue_entry *ss_run_queue_entry_get(void)
 {
+	struct ss_run_queue_entry *slab;
 	struct ss_run_queue_entry *rq_entry;
 	int i;
 
-	rq_entry = malloc(sizeof(struct ss_run_queue_entry));
+	if (run_queue_pool == NULL) {
+		rq_alloc_stats.entry_misses++;
+		slab = malloc(sizeof(struct ss_run_queue_entry) *
+			      SS_RQ_SLAB_ENTRIES);
+		if (slab == NULL)
+			return NULL;
+		for (i = 0; i < SS_RQ_SLAB_ENTRIES; i++)
+			run_queue_pool = eina_inlist_prepend(run_queue_pool,
+						EINA_INLIST_GET(&slab[i]));
+	} else
+		rq_alloc_stats.entry_hits++;
+
+	rq_entry = EINA_INLIST_CONTAINER_GET(run_queue_pool,
+					     struct ss_run_queue_entry);
+	run_queue_pool = eina_inlist_remove(run_queue_pool, run_queue_pool);
+	/* a recycled entry must not report the run time of its last use */
+	rq_entry->ran = 0;
+	return rq_entry;
+}
+
+static void ss_run_queue_entry_put(struct ss_run_queue_entry *rq_entry)
+{
+	if (rq_entry->arena != rq_entry->arena_buf)
+		free(rq_entry->arena);
+	rq_entry->arena = NULL;
+	run_queue_pool = eina_inlist_prepend(run_queue_pool,
+					     EINA_INLIST_GET(rq_entry));
+}
+
+/* copy all of argv into one arena that is released in one step */
+static int ss_run_queue_copy_argv(struct ss_run_queue_entry *rq_entry,
+				  int argc, char **argv)
+{
+	int len[SYSMAN_MAXARG];
+	int size = 0;
+	char *p;
+	int i;
+
+	for (i = 0; i < argc; i++) {
+		len[i] = argv[i] ? strlen(argv[i]) + 1 : 0;
+		size += len[i];
+	}
+
+	if (size <= SS_RQ_ARENA_SIZE) {
+		rq_alloc_stats.arena_hits++;
+		rq_entry->arena = rq_entry->arena_buf;
+	} else {
+		rq_alloc_stats.arena_misses++;
+		rq_entry->arena = malloc(size);
+		if (rq_entry->arena == NULL)
+			return -1;
+	}
+
+	p = rq_entry->arena;
+	for (i = 0; i < argc; i++) {
+		if (argv[i] == NULL) {
+			rq_entry->argv[i] = NULL;
+			continue;
+		}
+		memcpy(p, argv[i], len[i]);
+		rq_entry->argv[i] = p;
+		p += len[i];
+	}
+	rq_entry->argc = argc;
+
+	return 0;
+}
+
+static struct ss_run_queue_entry *__ss_run_queue_add(struct ss_action_entry
+						     *act_entry,
+						     enum ss_action_prio prio,
+						     int argc, char **argv)
+{
+	struct ss_run_queue_entry *rq_entry;
+
+	if (ss_action_entry_load(act_entry) < 0)
+		return NULL;
 
+	rq_entry = ss_run_queue_entry_get();
 	if (rq_entry == NULL) {
 		PRT_TRACE_ERR("Malloc failed");
-		return -1;
+		return NULL;
+	}
+
+	rq_entry->arena = NULL;
+	if (ss_run_queue_copy_argv(rq_entry, argc, argv) < 0) {
+		PRT_TRACE_ERR("Malloc failed");
+		ss_run_queue_entry_put(rq_entry);
+		return NULL;
 	}
 
+	act_entry->users++;
 	rq_entry->state = SS_STATE_INIT;
+	rq_entry->prio = prio;
+	rq_entry->base_prio = prio;
+	rq_entry->batch = 0;
+	rq_entry->queued = ecore_time_get();
+	rq_entry->added = rq_entry->queued;
+	rq_entry->started = 0;
+	rq_entry->wd_next = NULL;
+	rq_entry->wd_pprev = NULL;
 	rq_entry->action_entry = act_entry;
 	rq_entry->forked_pid = 0;
-	rq_entry->argc = argc;
-	for (i = 0; i < argc; i++)
-		rq_entry->argv[i] = argv[i];
+	rq_entry->status = 0;
+	memset(&rq_entry->rusage, 0, sizeof(rq_entry->rusage));
+	rq_entry->done = NULL;
+	rq_entry->done_data = NULL;
 
-	run_queue = eina_list_prepend(run_queue, rq_entry);
+	ss_run_queue_link(rq_entry);
 
 	PRT_TRACE_EM("[SYSMAN] new action called : %s", act_entry->type);
+	return rq_entry;
+}
+
+int ss_run_queue_add(struct ss_action_entry *act_entry, int argc, char **argv)
+{
+	if (__ss_run_queue_add(act_entry, act_entry->prio, argc, argv) == NULL)
+		return -1;
 	return 0;
 }
 
-int ss_run_queue_run(enum ss_run_state state,
-		     int (*run_func) (void *, struct ss_run_queue_entry *),
-		     void *user_data)
+void ss_run_queue_set_state(struct ss_run_queue_entry *rq_entry,
+			    enum ss_run_state state)
 {
-	Eina_List *tmp;
-	Eina_List *tmp_next;
-	struct ss_run_queue_entry *rq_entry;
+	if (rq_entry->state == state)
+		return;
 
-	EINA_LIST_FOREACH_SAFE(run_queue, tmp, tmp_next, rq_entry) {
-		if ((rq_entry != NULL) && (rq_entry->state == state))
-			run_func(user_data, rq_entry);
-	}
+	ss_run_queue_unlink(rq_entry);
+	rq_entry->state = state;
+	ss_run_queue_link(rq_entry);
+}
+
+int ss_run_queue_set_pid(struct ss_run_queue_entry *rq_entry, int pid)
+{
+	if (rq_entry->forked_pid > 0)
+		eina_hash_del(run_queue_pid_hash, &rq_entry->forked_pid,
+			      rq_entry);
+
+	rq_entry->forked_pid = pid;
+	if (pid <= 0)
+		return 0;
 
+	if (!eina_hash_add(run_queue_pid_hash, &rq_entry->forked_pid,
+			   rq_entry)) {
+		PRT_TRACE_ERR("run queue pid index add failed : %d", pid);
+		return -1;
+	}
 	return 0;
 }
 
-struct ss_run_queue_entry *ss_run_queue_find_bypid(int pid)
+/* move entries that waited too long up one class */
+static void ss_run_queue_age(double now)
 {
-	Eina_List *tmp;
-	Eina_List *tmp_next;
 	struct ss_run_queue_entry *rq_entry;
-
-	EINA_LIST_FOREACH_SAFE(run_queue, tmp, tmp_next, rq_entry) {
-		if ((rq_entry != NULL) && (rq_entry->forked_pid == pid))
-			return rq_entry;
+	int prio;
+
+	for (prio = SS_PRIO_INTERACTIVE; prio < SS_PRIO_MAX; prio++) {
+		/* lists are in queue order, the oldest is at the head */
+		while (run_queue_init[prio]) {
+			rq_entry = EINA_INLIST_CONTAINER_GET(run_queue_init[prio],
+						struct ss_run_queue_entry);
+			if (now - rq_entry->queued < SS_PRIO_AGE)
+				break;
+			ss_run_queue_unlink(rq_entry);
+			rq_entry->prio = prio - 1;
+			rq_entry->queued = now;
+			ss_run_queue_link(rq_entry);
+			run_queue_promoted++;
+		}
 	}
-
-	return NULL;
 }
 
-int ss_run_queue_del(struct ss_run_queue_entry *entry)
+int ss_run_queue_run(enum ss_run_state state,
+		     int (*run_func) (void *, struct ss_run_queue_entry *),
+		     void *user_data)
 {
-	Eina_List *tmp;
-	Eina_List *tmp_next;
+	Eina_Inlist *tmp_next;
 	struct ss_run_queue_entry *rq_entry;
-	int i;
+	int budget = SS_RUN_BUDGET;
+	int more = 0;
+	int exempt;
+	int prio;
+
+	if (state != SS_STATE_INIT) {
+		/* run_func may move the entry to another state list */
+		EINA_INLIST_FOREACH_SAFE(run_queue[state], tmp_next, rq_entry)
+			run_func(user_data, rq_entry);
+		return 0;
+	}
 
-	EINA_LIST_FOREACH_SAFE(run_queue, tmp, tmp_next, rq_entry) {
-		if ((rq_entry != NULL) && (rq_entry == entry)) {
-			run_queue = eina_list_remove(run_queue, rq_entry);
-			PRT_TRACE_EM("[SYSMAN] action deleted : %s",
-				     rq_entry->action_entry->type);
-			for (i = 0; i < rq_entry->argc; i++) {
-				if (rq_entry->argv[i])
-					free(rq_entry->argv[i]);
+	ss_run_queue_age(ecore_time_get());
+
+	/*
+	 * Only entries queued as critical and batches bypass the budget.
+	 * Promoted ones still count, or a burst that aged into the
+	 * critical class would all run in one pass.
+	 */
+	for (prio = SS_PRIO_CRITICAL; prio < SS_PRIO_MAX; prio++) {
+		EINA_INLIST_FOREACH_SAFE(run_queue_init[prio], tmp_next,
+					 rq_entry) {
+			exempt = (rq_entry->base_prio == SS_PRIO_CRITICAL ||
+				  rq_entry->batch);
+			/* keep walking, a batch may sit behind the rest */
+			if (!exempt && budget <= 0) {
+				more = 1;
+				continue;
 			}
-			free(rq_entry);
+			if (run_func(user_data, rq_entry) == 0 && !exempt)
+				budget--;
 		}
 	}
 
+	return more;
+}
+
+struct ss_run_queue_entry *ss_run_queue_find_bypid(int pid)
+{
+	if (pid <= 0)
+		return NULL;
+
+	return eina_hash_find(run_queue_pid_hash, &pid);
+}
+
+int ss_run_queue_del(struct ss_run_queue_entry *rq_entry)
+{
+	struct ss_action_entry *act_entry;
+
+	if (rq_entry == NULL)
+		return -1;
+
+	ss_run_queue_unlink(rq_entry);
+	ss_watchdog_disarm(rq_entry);
+	if (rq_entry->forked_pid > 0)
+		eina_hash_del(run_queue_pid_hash, &rq_entry->forked_pid,
+			      rq_entry);
+
+	PRT_TRACE_EM("[SYSMAN] action deleted : %s",
+		     rq_entry->action_entry->type);
+	if (rq_entry->done)
+		rq_entry->done(rq_entry, rq_entry->done_data);
+	act_entry = rq_entry->action_entry;
+	ss_run_queue_entry_put(rq_entry);
+	act_entry->last_used = ecore_time_get();
+	if (--act_entry->users == 0)
+		ss_action_entry_idle(act_entry);
+
 	return 0;
 }
 
 int ss_run_queue_del_bypid(int pid)
 {
-	Eina_List *tmp;
-	Eina_List *tmp_next;
+	Eina_Inlist *tmp_next;
 	struct ss_run_queue_entry *rq_entry;
-	int i;
 
-	EINA_LIST_FOREACH_SAFE(run_queue, tmp, tmp_next, rq_entry) {
-		if ((rq_entry != NULL) && (rq_entry->forked_pid == pid)) {
-			run_queue = eina_list_remove(run_queue, rq_entry);
-			PRT_TRACE_EM("[SYSMAN] action deleted : %s",
-				     rq_entry->action_entry->type);
-			for (i = 0; i < rq_entry->argc; i++) {
-				if (rq_entry->argv[i])
-					free(rq_entry->argv[i]);
-			}
-			free(rq_entry);
-		}
+	if (pid > 0)
+		return ss_run_queue_del(ss_run_queue_find_bypid(pid));
+
+	/* entries finished without a child all sit in the done list */
+	EINA_INLIST_FOREACH_SAFE(run_queue[SS_STATE_DONE], tmp_next, rq_entry) {
+		if (rq_entry->forked_pid == pid)
+			ss_run_queue_del(rq_entry);
 	}
 
 	return 0;
 }
 
+/* a forked child exited, record how and retire its entry */
+int ss_run_queue_retire(int pid, int status, const struct rusage *ru)
+{
+	struct ss_run_queue_entry *rq_entry;
+
+	rq_entry = ss_run_queue_find_bypid(pid);
+	if (rq_entry == NULL)
+		return -1;
+
+	rq_entry->status = status;
+	if (ru)
+		rq_entry->rusage = *ru;
+	ss_action_entry_account(rq_entry->action_entry, SYSNOTI_HIST_CHILD,
+				ecore_time_get() - rq_entry->started);
+	ss_run_queue_set_state(rq_entry, SS_STATE_DONE);
+	return ss_run_queue_del(rq_entry);
+}
+
+int ss_run_queue_depth(enum ss_run_state state)
+{
+	return run_queue_depth[state];
+}
+
+int ss_run_queue_peak_depth(enum ss_run_state state)
+{
+	return run_queue_peak[state];
+}
+
+int ss_run_queue_promoted(void)
+{
+	return run_queue_promoted;
+}
+
+const struct ss_run_queue_alloc_stats *ss_run_queue_alloc_stats(void)
+{
+	return &rq_alloc_stats;
+}
+
 void ss_queue_init()
 {
+	char *buf;
+
+	buf = getenv(SS_PLUGIN_IDLE_ENV);
+	if (buf != NULL && strlen(buf) < 16 && atoi(buf) >= 0)
+		plugin_idle_timeout = atoi(buf);
+
+	predef_act_hash = eina_hash_string_superfast_new(NULL);
+	if (predef_act_hash == NULL)
+		PRT_TRACE_ERR("action registry init failed");
 
+	run_queue_pid_hash = eina_hash_int32_new(NULL);
+	if (run_queue_pid_hash == NULL)
+		PRT_TRACE_ERR("run queue pid index init failed");
 }
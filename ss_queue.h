@@ -18,9 +18,76 @@
 #ifndef __SS_QUEUE_H__
 #define __SS_QUEUE_H__
 
+#include <sys/resource.h>
 #include "ss_sysnoti.h"
+#include "include/ss_sysnoti_proto.h"
+
+/* built-in actions, resolved without a name lookup */
+enum ss_action_id {
+	SS_ACTION_LOWMEM,
+	SS_ACTION_LOWBAT,
+	SS_ACTION_USBCON,
+	SS_ACTION_EARJACKCON,
+	SS_ACTION_POWEROFF,
+	SS_ACTION_PWROFF_POPUP,
+	SS_ACTION_REBOOT,
+	SS_ACTION_FOREGRD,
+	SS_ACTION_BACKGRD,
+	SS_ACTION_ACTIVE,
+	SS_ACTION_INACTIVE,
+	SS_ACTION_OOMADJ_SET,
+	SS_ACTION_SET_DATETIME,
+	SS_ACTION_SET_TIMEZONE,
+	SS_ACTION_MOUNT_MMC,
+	SS_ACTION_UNMOUNT_MMC,
+	SS_ACTION_FORMAT_MMC,
+	SS_ACTION_SET_MAX_FREQUENCY,
+	SS_ACTION_SET_MIN_FREQUENCY,
+	SS_ACTION_RELEASE_MAX_FREQUENCY,
+	SS_ACTION_RELEASE_MIN_FREQUENCY,
+	SS_ACTION_USB_STORAGE_ADD,
+	SS_ACTION_USB_STORAGE_REMOVE,
+	SS_ACTION_ID_MAX
+};
+
+/*
+ * Actions on a lane other than SS_LANE_MAIN run on a worker thread
+ * instead of the main loop. Entries on the same lane run one at a time
+ * in queue order, different lanes run in parallel. Only actions known
+ * to be thread-safe may leave the main loop: anything that touches
+ * vconf, syspopup, device properties or handler state stays on
+ * SS_LANE_MAIN, which keeps it ordered with later events as well.
+ * Plugins opt in by exporting ss_thread_safe.
+ */
+enum ss_action_lane {
+	SS_LANE_MAIN,		/* runs inline on the main loop, the default */
+	SS_LANE_PLUGIN,		/* plugins exporting ss_thread_safe */
+	SS_LANE_MAX
+};
+
+/*
+ * Dispatch order of queued entries. Higher classes are always served
+ * first; entries that wait too long are promoted one class at a time so
+ * the lower classes cannot starve.
+ */
+enum ss_action_prio {
+	SS_PRIO_CRITICAL,	/* poweroff, OOM kill */
+	SS_PRIO_INTERACTIVE,	/* default for built-in actions */
+	SS_PRIO_BACKGROUND,	/* logs, plugins */
+	SS_PRIO_MAX
+};
 
 struct ss_action_entry {
+	int id;			/* enum ss_action_id, -1 for plugins */
+	enum ss_action_lane lane;
+	enum ss_action_prio prio;	/* default class of its calls */
+	double timeout;		/* seconds a forked child may run, 0 = forever */
+	int users;		/* run queue entries of this action */
+	double last_used;	/* ecore_time_get() when the last one retired */
+	int idle_unload;	/* plugin exports ss_idle_unload */
+	int stale;		/* library replaced, unload once idle */
+	int removed;		/* library deleted, free once idle */
+	struct sysnoti_action_stats stats;
 	int owner_pid;
 	void *handle;
 	char *type;
@@ -30,18 +97,55 @@ struct ss_action_entry {
 	int (*is_accessable) (int caller_pid);
 };
 
+/* argv bytes stored inside a run queue entry before falling back to malloc */
+#define SS_RQ_ARENA_SIZE	256
+
+#define SS_RUN_BUDGET		8	/* non-critical, non-batch entries per pass */
+#define SS_PRIO_AGE		1.0	/* seconds before promotion */
+
 enum ss_run_state {
 	SS_STATE_INIT,
 	SS_STATE_RUNNING,
-	SS_STATE_DONE
+	SS_STATE_DONE,
+	SS_STATE_MAX
 };
 
+/*
+ * Entries are linked into the list of their state; use
+ * ss_run_queue_set_state() and ss_run_queue_set_pid() to change state
+ * and forked_pid so that the lists and the pid index stay in sync.
+ */
 struct ss_run_queue_entry {
+	EINA_INLIST;
 	enum ss_run_state state;
+	enum ss_action_prio prio;
+	enum ss_action_prio base_prio;	/* class it was queued in */
+	int batch;		/* queued by CALL_SYSMAN_ACTION_BATCH */
+	double queued;		/* ecore_time_get() when queued or promoted */
+	double added;		/* ecore_time_get() when queued */
+	double started;		/* ecore_time_get() when dispatched */
+	double ran;		/* run time on a worker thread */
+	struct ss_run_queue_entry *wd_next;	/* watchdog wheel slot */
+	struct ss_run_queue_entry **wd_pprev;	/* NULL when not armed */
+	unsigned int wd_rounds;
+	int wd_stage;
 	struct ss_action_entry *action_entry;
 	int forked_pid;
+	int status;
+	struct rusage rusage;	/* filled in when the forked child is reaped */
+	void (*done) (struct ss_run_queue_entry *, void *);
+	void *done_data;
 	int argc;
 	char *argv[SYSMAN_MAXARG];
+	char *arena;		/* argv strings, arena_buf unless too large */
+	char arena_buf[SS_RQ_ARENA_SIZE];
+};
+
+struct ss_run_queue_alloc_stats {
+	unsigned int entry_hits;	/* entries reused from the pool */
+	unsigned int entry_misses;	/* pool empty, a new slab was allocated */
+	unsigned int arena_hits;	/* argv fit into the entry */
+	unsigned int arena_misses;	/* argv needed a separate allocation */
 };
 
 int ss_action_entry_add_internal(char *type,
@@ -49,17 +153,55 @@ int ss_action_entry_add_internal(char *type,
 				 int (*ui_viewable) (),
 				 int (*is_accessable) (int));
 int ss_action_entry_add(struct sysnoti *msg);
+int ss_action_entry_plugins_loaded(void);
+int ss_action_entry_reload(const char *type);
+int ss_action_entry_del(const char *type);
+/* moving an action off SS_LANE_MAIN declares it thread-safe */
+int ss_action_entry_set_lane(char *type, enum ss_action_lane lane);
+int ss_action_entry_set_prio(char *type, enum ss_action_prio prio);
+/* opt-in, only for actions whose child is known to be short-lived;
+ * plugins declare theirs with an exported int ss_action_timeout */
+int ss_action_entry_set_timeout(char *type, double timeout);
+void ss_action_entry_account(struct ss_action_entry *data,
+			     enum sysnoti_hist hist, double sec);
+struct ss_action_entry *ss_action_entry_find(const char *type);
+int ss_action_entry_count(void);
+void ss_action_entry_foreach(int (*func) (struct ss_action_entry *, void *),
+			     void *user_data);
 int ss_action_entry_call_internal(char *type, int argc, ...);
+int ss_action_entry_call_internal_id(enum ss_action_id id, int argc, ...);
+int ss_action_entry_call_internal_prio(enum ss_action_id id,
+				       enum ss_action_prio prio, int argc, ...);
 int ss_action_entry_call(struct sysnoti *msg, int argc, char **argv);
+int ss_action_entry_call_batch(struct sysnoti *msgs, int n, int *results);
+int ss_action_entry_call_notify(struct sysnoti *msg, int argc, char **argv,
+				void (*done) (struct ss_run_queue_entry *,
+					      void *), void *done_data);
 
+/*
+ * run_func returns non-zero when it left the entry queued. For
+ * SS_STATE_INIT one pass runs every critical entry but at most
+ * SS_RUN_BUDGET of the others, and returns 1 if it stopped early.
+ * Entries of a batch share one class and are exempt from the budget,
+ * so a batch keeps its record order and is dispatched by one wakeup.
+ */
 int ss_run_queue_run(enum ss_run_state state,
 		     int (*run_func) (void *, struct ss_run_queue_entry *),
 		     void *user_data);
 
 struct ss_run_queue_entry *ss_run_queue_find_bypid(int pid);
+/* argv is copied, the caller keeps ownership of it */
 int ss_run_queue_add(struct ss_action_entry *act_entry, int argc, char **argv);
 int ss_run_queue_del(struct ss_run_queue_entry *entry);
 int ss_run_queue_del_bypid(int pid);
+int ss_run_queue_retire(int pid, int status, const struct rusage *ru);
+void ss_run_queue_set_state(struct ss_run_queue_entry *rq_entry,
+			    enum ss_run_state state);
+int ss_run_queue_set_pid(struct ss_run_queue_entry *rq_entry, int pid);
+int ss_run_queue_depth(enum ss_run_state state);
+int ss_run_queue_peak_depth(enum ss_run_state state);
+int ss_run_queue_promoted(void);
+const struct ss_run_queue_alloc_stats *ss_run_queue_alloc_stats(void);
 
 void ss_queue_init();
 
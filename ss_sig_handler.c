@@ -16,39 +16,51 @@
 
 
 #include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <Ecore.h>
+#include "ss_log.h"
+#include "ss_queue.h"
 #include "ss_core.h"
 
-#define PRT_TRACE_ERR(format, args...) do { \
-	char buf[255];\
-	snprintf(buf, 255, format, ##args);\
-	write(2, buf, strlen(buf));\
-} while (0);
-
-#define PRT_TRACE(format, args...) do { \
-	char buf[255];\
-	snprintf(buf, 255, format, ##args);\
-	write(1, buf, strlen(buf));\
-} while (0);
-
-static struct sigaction sig_child_old_act;
 static struct sigaction sig_pipe_old_act;
+static int sig_child_fd = -1;
+static int sig_child_pipe[2] = { -1, -1 };
 
-static void sig_child_handler(int signo, siginfo_t *info, void *data)
+/*
+ * SIGCHLD is blocked and delivered through a signalfd, so children are
+ * reaped from the main loop. Pending SIGCHLDs coalesce, so every wakeup
+ * reaps until no exited child is left. Without signalfd a SIGCHLD
+ * handler wakes the same callback through a pipe instead.
+ */
+static int sig_child_cb(void *data, Ecore_Fd_Handler *fd_handler)
 {
+	struct signalfd_siginfo si[8];
+	struct rusage ru;
 	pid_t pid;
 	int status;
 
-	pid = waitpid(info->si_pid, &status, 0);
-	if (pid == -1) {
-		PRT_TRACE_ERR("SIGCHLD received\n");
-		return;
+	if (!ecore_main_fd_handler_active_get(fd_handler, ECORE_FD_READ)) {
+		PRT_TRACE_ERR
+		    ("ecore_main_fd_handler_active_get error , return\n");
+		return 1;
 	}
 
-	PRT_TRACE("sig child actend call - %d\n", info->si_pid);
+	while (read(sig_child_fd, si, sizeof(si)) == sizeof(si))
+		;
 
-	ss_core_action_clear(info->si_pid);
+	while ((pid = wait4(-1, &status, WNOHANG, &ru)) > 0) {
+		PRT_TRACE("sig child actend call - %d", pid);
+		ss_run_queue_retire(pid, status, &ru);
+	}
+
+	return 1;
 }
 
 static void sig_pipe_handler(int signo, siginfo_t *info, void *data)
@@ -56,15 +68,71 @@ static void sig_pipe_handler(int signo, siginfo_t *info, void *data)
 
 }
 
-void ss_signal_init()
+static void sig_child_handler(int signo, siginfo_t *info, void *data)
+{
+	int saved_errno = errno;
+
+	write(sig_child_pipe[1], "", 1);
+	errno = saved_errno;
+}
+
+/* signalfd is unavailable, SIGCHLD must not stay blocked */
+static void sig_child_fallback(const sigset_t *mask)
 {
 	struct sigaction sig_act;
 
-	sig_act.sa_handler = NULL;
-	sig_act.sa_sigaction = sig_child_handler;
-	sig_act.sa_flags = SA_SIGINFO;
+	sigprocmask(SIG_UNBLOCK, mask, NULL);
 	sigemptyset(&sig_act.sa_mask);
-	sigaction(SIGCHLD, &sig_act, &sig_child_old_act);
+
+	if (pipe(sig_child_pipe) == 0) {
+		fcntl(sig_child_pipe[0], F_SETFL, O_NONBLOCK);
+		fcntl(sig_child_pipe[1], F_SETFL, O_NONBLOCK);
+		fcntl(sig_child_pipe[0], F_SETFD, FD_CLOEXEC);
+		fcntl(sig_child_pipe[1], F_SETFD, FD_CLOEXEC);
+		sig_child_fd = sig_child_pipe[0];
+		if (ecore_main_fd_handler_add(sig_child_fd, ECORE_FD_READ,
+					      sig_child_cb, NULL, NULL,
+					      NULL) != NULL) {
+			sig_act.sa_handler = NULL;
+			sig_act.sa_sigaction = sig_child_handler;
+			sig_act.sa_flags = SA_SIGINFO | SA_RESTART |
+			    SA_NOCLDSTOP;
+			sigaction(SIGCHLD, &sig_act, NULL);
+			return;
+		}
+		close(sig_child_pipe[0]);
+		close(sig_child_pipe[1]);
+		sig_child_fd = -1;
+	}
+
+	/* last resort: the kernel reaps, exits go unnoticed */
+	PRT_TRACE_ERR("no SIGCHLD delivery, children are not tracked");
+	sig_act.sa_handler = SIG_DFL;
+	sig_act.sa_flags = SA_NOCLDWAIT;
+	sigaction(SIGCHLD, &sig_act, NULL);
+}
+
+void ss_signal_init()
+{
+	struct sigaction sig_act;
+	sigset_t mask;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0)
+		PRT_TRACE_ERR("sigprocmask failed");
+
+	sig_child_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (sig_child_fd >= 0 &&
+	    ecore_main_fd_handler_add(sig_child_fd, ECORE_FD_READ,
+				      sig_child_cb, NULL, NULL, NULL) == NULL) {
+		close(sig_child_fd);
+		sig_child_fd = -1;
+	}
+	if (sig_child_fd < 0) {
+		PRT_TRACE_ERR("signalfd failed, using a SIGCHLD handler");
+		sig_child_fallback(&mask);
+	}
 
 	sig_act.sa_handler = NULL;
 	sig_act.sa_sigaction = sig_pipe_handler;
@@ -15,152 +15,948 @@
 */
 
 
+#define _GNU_SOURCE		/* struct ucred */
 #include <sysman.h>
+#include <vconf.h>
 #include <limits.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/stat.h>
 #include "include/ss_data.h"
+#include "include/ss_sysnoti_proto.h"
 #include "ss_log.h"
 #include "ss_queue.h"
+#include "ss_predefine.h"
+#include "ss_procmgr.h"
+#include "ss_proc_event.h"
 
-#define SYSNOTI_SOCKET_PATH "/tmp/sn"
+#define SYSNOTI_MAX_SESSIONS	32
+#define SYSNOTI_MAX_CLIENTS	64	/* one-shot clients at a time */
+#define SYSNOTI_STRBUF_SIZE	4096
+#define SYSNOTI_RECV_SIZE	512
+/* a request must be received completely within this many seconds */
+#define SYSNOTI_REQ_TIMEOUT	3
+#define SYSNOTI_NAME_CACHE_SIZE	16
+/* replies queued for a client that does not read them */
+#define SYSNOTI_OUT_MAX		(64 * 1024)
 
-enum sysnoti_cmd {
-	ADD_SYSMAN_ACTION,
-	CALL_SYSMAN_ACTION
+/* VCONFKEY_INTERNAL_SYSNOTI_TRACE values */
+enum sysnoti_trace {
+	SYSNOTI_TRACE_OFF,
+	SYSNOTI_TRACE_SUMMARY,
+	SYSNOTI_TRACE_FULL
 };
 
+struct sysnoti_name_entry {
+	int pid;
+	int tick;
+	char name[128];
+};
+
+/*
+ * Request fields in wire order. Integers are host-endian ints, strings are
+ * an int length followed by that many bytes (no body when length <= 0).
+ */
+enum sysnoti_parse_state {
+	PARSE_PID,
+	PARSE_CMD,
+	PARSE_TYPE_LEN,
+	PARSE_TYPE,
+	PARSE_PATH_LEN,
+	PARSE_PATH,
+	PARSE_ARGC,
+	PARSE_ARG_LEN,
+	PARSE_ARG,
+	PARSE_DONE
+};
+
+struct sysnoti_parser {
+	enum sysnoti_parse_state state;
+	int val;		/* int field being assembled */
+	int got;		/* bytes of the current field received so far */
+	int len;		/* length of the current string field */
+	int arg;		/* argv index of the current argument */
+	char **str;		/* destination of the current string field */
+	int used;		/* bytes of strbuf in use */
+	struct sysnoti msg;
+	char strbuf[SYSNOTI_STRBUF_SIZE];
+};
+
+/*
+ * A client connection. One-shot clients are closed after the first reply,
+ * session clients (opened with OPEN_SYSMAN_SESSION) keep the socket and
+ * send further requests, each of them answered by its own int reply.
+ * Sockets are non-blocking and requests are parsed as bytes arrive, so a
+ * slow client never stalls the main loop. v2 (seqpacket) clients are
+ * always sessions and do not use the stream parser.
+ *
+ * A client with pending CALL_SYSMAN_ACTION_WAIT requests is only freed
+ * after the last completion, even if its socket is already closed.
+ *
+ * A one-shot client has SYSNOTI_REQ_TIMEOUT seconds from accept() to
+ * deliver its whole request, a session from the first byte of each
+ * request. deadline is 0 while no such limit runs.
+ *
+ * Replies that do not fit into the socket buffer are queued on out and
+ * sent as the socket becomes writable; a client closed with replies
+ * still queued is only closed once they are out (closing).
+ */
+struct sysnoti_client {
+	int fd;
+	struct ucred cred;	/* peer identity, from SO_PEERCRED */
+	int persistent;
+	int seqpacket;
+	int seq;		/* requests received so far */
+	int pending;		/* completions still to be sent */
+	double deadline;
+	int reading;		/* still accepting requests */
+	int closing;		/* close once out is drained */
+	Eina_List *out;		/* struct sysnoti_out, oldest first */
+	int out_bytes;
+	Ecore_Fd_Handler *handler;
+	struct sysnoti_parser parser;
+};
+
+struct sysnoti_out {
+	int len;
+	int off;		/* bytes already sent */
+	char data[];
+};
+
+static Eina_List *client_list;
+static int session_cnt;
+static int oneshot_cnt;
+static int sysnoti_trace_level = SYSNOTI_TRACE_OFF;
+static Ecore_Timer *sweep_timer;
+
+/* v2 frames are handled one at a time on the main loop, in place */
+static char v2_frame[SYSNOTI_V2_MAX_FRAME] __attribute__ ((aligned(8)));
+static struct sysnoti v2_msgs[SYSNOTI_V2_MAX_BATCH];
+static int v2_results[SYSNOTI_V2_MAX_BATCH];
+
+static Eina_Bool sysnoti_sweep_cb(void *data);
+static int sysnoti_client_cb(void *data, Ecore_Fd_Handler * fd_handler);
+static int sysnoti_v2_client_cb(void *data, Ecore_Fd_Handler * fd_handler);
+
+static int sysnoti_name_tick;
+static struct sysnoti_name_entry name_cache[SYSNOTI_NAME_CACHE_SIZE];
+
+static void sysnoti_name_event_cb(int pid, enum ss_proc_event event,
+				  void *data)
+{
+	/* gone, or an exec changed its cmdline */
+	ss_sysnoti_forget_pid(pid);
+}
+
+/* small pid keyed LRU, only consulted while request tracing is on */
+static const char *sysnoti_name_lookup(int pid)
+{
+	struct sysnoti_name_entry *victim = &name_cache[0];
+	int i;
+
+	for (i = 0; i < SYSNOTI_NAME_CACHE_SIZE; i++) {
+		if (name_cache[i].pid == pid) {
+			name_cache[i].tick = ++sysnoti_name_tick;
+			return name_cache[i].name;
+		}
+		if (name_cache[i].tick < victim->tick)
+			victim = &name_cache[i];
+	}
+
+	if (victim->pid != 0)
+		ss_proc_event_unsubscribe(victim->pid, sysnoti_name_event_cb,
+					  NULL);
+	victim->pid = 0;
+	victim->tick = 0;
+
+	if (sysman_get_cmdline_name(pid, victim->name,
+				    sizeof(victim->name)) < 0)
+		return "Unknown (maybe dead)";
+	if (ss_proc_event_subscribe(pid, SS_PROC_EVENT_EXIT |
+				    SS_PROC_EVENT_EXEC,
+				    sysnoti_name_event_cb, NULL) < 0)
+		return victim->name;
+
+	victim->pid = pid;
+	victim->tick = ++sysnoti_name_tick;
+	return victim->name;
+}
+
+void ss_sysnoti_forget_pid(int pid)
+{
+	int i;
+
+	for (i = 0; i < SYSNOTI_NAME_CACHE_SIZE; i++) {
+		if (name_cache[i].pid == pid) {
+			ss_proc_event_unsubscribe(pid, sysnoti_name_event_cb,
+						  NULL);
+			name_cache[i].pid = 0;
+			name_cache[i].tick = 0;
+		}
+	}
+}
+
 static void print_sysnoti_msg(const char *title, struct sysnoti *msg)
 {
 	int i;
-	char exe_name[PATH_MAX];
+	const char *exe_name;
+
+	if (sysnoti_trace_level == SYSNOTI_TRACE_OFF)
+		return;
 
-	if (sysman_get_cmdline_name(msg->pid, exe_name, PATH_MAX) < 0)
-		snprintf(exe_name, sizeof(exe_name), "Unknown (maybe dead)");
+	exe_name = sysnoti_name_lookup(msg->pid);
 
-	PRT_TRACE_ERR("=====================");
-	PRT_TRACE_ERR("pid : %d", msg->pid);
-	PRT_TRACE_ERR("process name : %s", exe_name);
-	PRT_TRACE_ERR("cmd : %d", msg->cmd);
-	PRT_TRACE_ERR("type : %s", msg->type);
-	PRT_TRACE_ERR("path : %s", msg->path);
+	if (sysnoti_trace_level == SYSNOTI_TRACE_SUMMARY) {
+		PRT_TRACE("%s : pid %d (%s) uid %d cmd %d type %s", title,
+			  msg->pid, exe_name, msg->uid, msg->cmd, msg->type);
+		return;
+	}
+
+	PRT_TRACE("=====================");
+	PRT_TRACE("pid : %d", msg->pid);
+	PRT_TRACE("uid : %d, gid : %d", msg->uid, msg->gid);
+	PRT_TRACE("process name : %s", exe_name);
+	PRT_TRACE("cmd : %d", msg->cmd);
+	PRT_TRACE("type : %s", msg->type);
+	PRT_TRACE("path : %s", msg->path);
 	for (i = 0; i < msg->argc; i++)
-		PRT_TRACE_ERR("arg%d : %s", i, msg->argv[i]);
-	PRT_TRACE_ERR("=====================");
+		PRT_TRACE("arg%d : %s", i, msg->argv[i]);
+	PRT_TRACE("=====================");
 }
 
-static inline int recv_int(int fd)
+static void sysnoti_trace_changed(keynode_t *key_nodes, void *data)
 {
-	int val, r = -1;
-	while(1) {
-		r = read(fd, &val, sizeof(int));
-		if (r < 0) {
-			if(errno == EINTR) {
-				PRT_TRACE_ERR("Re-read for error(EINTR)");
-				continue;
+	sysnoti_trace_level = vconf_keynode_get_int(key_nodes);
+	PRT_TRACE_ERR("sysnoti trace level : %d", sysnoti_trace_level);
+}
+
+static void sysnoti_parser_reset(struct sysnoti_parser *p)
+{
+	p->state = PARSE_PID;
+	p->got = 0;
+	p->used = 0;
+	p->msg.type = NULL;
+	p->msg.path = NULL;
+	p->msg.argc = 0;
+}
+
+static inline int sysnoti_parser_busy(struct sysnoti_parser *p)
+{
+	return (p->state != PARSE_PID || p->got != 0);
+}
+
+/* returns 0 when the int is complete, 1 when more bytes are needed */
+static int parse_int(struct sysnoti_parser *p, const char **buf, int *len)
+{
+	int n = sizeof(int) - p->got;
+
+	if (n > *len)
+		n = *len;
+	memcpy((char *)&p->val + p->got, *buf, n);
+	p->got += n;
+	*buf += n;
+	*len -= n;
+	if (p->got < sizeof(int))
+		return 1;
+	p->got = 0;
+	return 0;
+}
+
+static int parse_str_len(struct sysnoti_parser *p, char **dst)
+{
+	*dst = NULL;
+	if (p->val <= 0)
+		return 0;
+
+	if (p->val >= sizeof(p->strbuf) - p->used) {
+		PRT_TRACE_ERR("sysnoti request too large (%d)", p->val);
+		return -1;
+	}
+
+	p->len = p->val;
+	p->str = dst;
+	*dst = p->strbuf + p->used;
+	p->used += p->len + 1;
+	return 1;
+}
+
+/* returns 0 when the string is complete, 1 when more bytes are needed */
+static int parse_str(struct sysnoti_parser *p, const char **buf, int *len)
+{
+	int n = p->len - p->got;
+
+	if (n > *len)
+		n = *len;
+	memcpy(*p->str + p->got, *buf, n);
+	p->got += n;
+	*buf += n;
+	*len -= n;
+	if (p->got < p->len)
+		return 1;
+	(*p->str)[p->len] = 0;
+	p->got = 0;
+	return 0;
+}
+
+/*
+ * Feed received bytes into the parser. Returns the number of bytes consumed
+ * (stopping right after a complete request, state PARSE_DONE) or -1 on a
+ * malformed request.
+ */
+static int sysnoti_parse(struct sysnoti_parser *p, const char *buf, int len)
+{
+	const char *start = buf;
+	struct sysnoti *msg = &p->msg;
+	int r;
+
+	while (len > 0 && p->state != PARSE_DONE) {
+		switch (p->state) {
+		case PARSE_PID:
+			if (parse_int(p, &buf, &len))
+				break;
+			msg->pid = p->val;
+			p->state = PARSE_CMD;
+			break;
+		case PARSE_CMD:
+			if (parse_int(p, &buf, &len))
+				break;
+			msg->cmd = p->val;
+			p->state = PARSE_TYPE_LEN;
+			break;
+		case PARSE_TYPE_LEN:
+			if (parse_int(p, &buf, &len))
+				break;
+			r = parse_str_len(p, &msg->type);
+			if (r < 0)
+				return -1;
+			p->state = r ? PARSE_TYPE : PARSE_PATH_LEN;
+			break;
+		case PARSE_TYPE:
+			if (parse_str(p, &buf, &len))
+				break;
+			p->state = PARSE_PATH_LEN;
+			break;
+		case PARSE_PATH_LEN:
+			if (parse_int(p, &buf, &len))
+				break;
+			r = parse_str_len(p, &msg->path);
+			if (r < 0)
+				return -1;
+			p->state = r ? PARSE_PATH : PARSE_ARGC;
+			break;
+		case PARSE_PATH:
+			if (parse_str(p, &buf, &len))
+				break;
+			p->state = PARSE_ARGC;
+			break;
+		case PARSE_ARGC:
+			if (parse_int(p, &buf, &len))
+				break;
+			if (p->val < 0 || p->val > SYSMAN_MAXARG) {
+				PRT_TRACE_ERR("%s : error argument", __FUNCTION__);
+				return -1;
 			}
-			else {
-				PRT_TRACE_ERR("Read fail for int");
+			msg->argc = p->val;
+			p->arg = 0;
+			p->state = msg->argc ? PARSE_ARG_LEN : PARSE_DONE;
+			break;
+		case PARSE_ARG_LEN:
+			if (parse_int(p, &buf, &len))
+				break;
+			r = parse_str_len(p, &msg->argv[p->arg]);
+			if (r < 0)
 				return -1;
+			if (r) {
+				p->state = PARSE_ARG;
+				break;
 			}
-		} else {
-			return val;
+			p->state = (++p->arg < msg->argc) ?
+			    PARSE_ARG_LEN : PARSE_DONE;
+			break;
+		case PARSE_ARG:
+			if (parse_str(p, &buf, &len))
+				break;
+			p->state = (++p->arg < msg->argc) ?
+			    PARSE_ARG_LEN : PARSE_DONE;
+			break;
+		default:
+			return -1;
 		}
 	}
+
+	return buf - start;
 }
 
-static inline char *recv_str(int fd)
+struct sysnoti_wait {
+	struct sysnoti_client *client;
+	int seq;
+};
+
+static void sysnoti_deadline_arm(struct sysnoti_client *client)
 {
-	int len, r = -1;
-	char *str;
+	client->deadline = ecore_time_get() + SYSNOTI_REQ_TIMEOUT;
+	if (sweep_timer == NULL)
+		sweep_timer = ecore_timer_add(1, sysnoti_sweep_cb, NULL);
+}
 
-	while(1) {
-		r = read(fd, &len, sizeof(int));
-		if (r < 0) {
-			if(errno == EINTR) {
-				PRT_TRACE_ERR("Re-read for error(EINTR)");
-				continue;
-			}
-			else {
-				PRT_TRACE_ERR("Read fail for str length");
-				return NULL;
-			}
+/* watch the socket for what the client still needs */
+static int sysnoti_client_watch(struct sysnoti_client *client)
+{
+	int flags = 0;
+
+	if (client->reading)
+		flags |= ECORE_FD_READ;
+	if (client->out)
+		flags |= ECORE_FD_WRITE;
+
+	if (flags == 0) {
+		if (client->handler)
+			ecore_main_fd_handler_del(client->handler);
+		client->handler = NULL;
+		return 0;
+	}
+
+	if (client->handler) {
+		ecore_main_fd_handler_active_set(client->handler, flags);
+		return 0;
+	}
+
+	client->handler =
+	    ecore_main_fd_handler_add(client->fd, flags,
+				      client->seqpacket ? sysnoti_v2_client_cb :
+				      sysnoti_client_cb, client, NULL, NULL);
+	return client->handler ? 0 : -1;
+}
+
+static void sysnoti_out_free(struct sysnoti_client *client)
+{
+	struct sysnoti_out *o;
+
+	EINA_LIST_FREE(client->out, o)
+		free(o);
+	client->out_bytes = 0;
+}
+
+static void sysnoti_client_del(struct sysnoti_client *client)
+{
+	/* let queued replies go out first, the sweep drops a stuck peer */
+	if (client->fd >= 0 && client->out && !client->closing) {
+		client->closing = 1;
+		client->reading = 0;
+		if (sysnoti_client_watch(client) == 0) {
+			sysnoti_deadline_arm(client);
+			return;
+		}
+	}
+
+	sysnoti_out_free(client);
+	if (client->fd >= 0) {
+		client_list = eina_list_remove(client_list, client);
+		if (client->persistent) {
+			session_cnt--;
+			ss_sysnoti_forget_pid(client->cred.pid);
 		} else
+			oneshot_cnt--;
+		if (client->handler)
+			ecore_main_fd_handler_del(client->handler);
+		close(client->fd);
+		client->fd = -1;
+	}
+
+	if (client->pending == 0)
+		free(client);
+}
+
+/*
+ * Send one reply. Whatever the socket does not take right away is queued
+ * and sent in order once it is writable, seqpacket replies are only
+ * ever queued whole.
+ */
+static int sysnoti_send(struct sysnoti_client *client, const void *buf,
+			int len)
+{
+	struct sysnoti_out *o;
+	int n = 0;
+
+	if (client->fd < 0 || client->closing)
+		return -1;
+
+	if (client->out == NULL) {
+		n = send(client->fd, buf, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (n == len)
+			return 0;
+		if (n < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK &&
+			    errno != EINTR) {
+				PRT_TRACE_ERR("sysnoti reply to fd %d failed : %s",
+					      client->fd, strerror(errno));
+				return -1;
+			}
+			n = 0;
+		}
+	}
+
+	if (client->out_bytes + len - n > SYSNOTI_OUT_MAX) {
+		/* the read side sees the shutdown and drops the client */
+		PRT_TRACE_ERR("sysnoti fd %d does not read its replies",
+			      client->fd);
+		sysnoti_out_free(client);
+		shutdown(client->fd, SHUT_RDWR);
+		return -1;
+	}
+
+	o = malloc(sizeof(struct sysnoti_out) + len - n);
+	if (o == NULL) {
+		PRT_TRACE_ERR("%s : Not enough memory", __FUNCTION__);
+		return -1;
+	}
+	o->len = len - n;
+	o->off = 0;
+	memcpy(o->data, (const char *)buf + n, len - n);
+	client->out = eina_list_append(client->out, o);
+	client->out_bytes += o->len;
+	return sysnoti_client_watch(client);
+}
+
+/* send queued replies, -1 if the client is gone */
+static int sysnoti_flush(struct sysnoti_client *client)
+{
+	struct sysnoti_out *o;
+	int n;
+
+	while (client->out) {
+		o = eina_list_data_get(client->out);
+		n = send(client->fd, o->data + o->off, o->len - o->off,
+			 MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK ||
+			    errno == EINTR)
+				return 0;
+			sysnoti_out_free(client);
+			return -1;
+		}
+		o->off += n;
+		if (o->off < o->len)
+			return 0;
+		client->out_bytes -= o->len;
+		client->out = eina_list_remove_list(client->out, client->out);
+		free(o);
+	}
+
+	return sysnoti_client_watch(client);
+}
+
+static void sysnoti_done_cb(struct ss_run_queue_entry *rq_entry, void *data)
+{
+	struct sysnoti_wait *wait = (struct sysnoti_wait *)data;
+	struct sysnoti_client *client = wait->client;
+	struct sysnoti_done done;
+
+	client->pending--;
+
+	if (client->fd >= 0) {
+		done.magic = SYSNOTI_DONE_MAGIC;
+		done.seq = wait->seq;
+		done.pid = rq_entry->forked_pid > 0 ? rq_entry->forked_pid : 0;
+		done.status = rq_entry->status;
+		sysnoti_send(client, &done, sizeof(done));
+	}
+	free(wait);
+
+	/* a one-shot client only waited for this completion */
+	if (client->fd < 0 || !client->persistent)
+		sysnoti_client_del(client);
+}
+
+static int sysnoti_call_wait(struct sysnoti_client *client,
+			     struct sysnoti *msg)
+{
+	struct sysnoti_wait *wait;
+
+	wait = malloc(sizeof(struct sysnoti_wait));
+	if (wait == NULL) {
+		PRT_TRACE_ERR("%s : Not enough memory", __FUNCTION__);
+		return -1;
+	}
+
+	wait->client = client;
+	wait->seq = client->seq;
+	if (ss_action_entry_call_notify(msg, msg->argc, msg->argv,
+					sysnoti_done_cb, wait) < 0) {
+		free(wait);
+		return -1;
+	}
+
+	client->pending++;
+	return 0;
+}
+
+static int sysnoti_session_open(struct sysnoti_client *client)
+{
+	if (client->persistent)
+		return 0;
+
+	if (session_cnt >= SYSNOTI_MAX_SESSIONS) {
+		PRT_TRACE_ERR("too many sysnoti sessions (%d)", session_cnt);
+		return -1;
+	}
+
+	client->persistent = 1;
+	oneshot_cnt--;
+	session_cnt++;
+	return 0;
+}
+
+static int sysnoti_handle_msg(struct sysnoti_client *client,
+			      struct sysnoti *msg)
+{
+	int ret;
+
+	/* never trust the pid the client put in the message */
+	msg->pid = client->cred.pid;
+	msg->uid = client->cred.uid;
+	msg->gid = client->cred.gid;
+
+	print_sysnoti_msg(__FUNCTION__, msg);
+	client->seq++;
+
+	switch (msg->cmd) {
+	case ADD_SYSMAN_ACTION:
+		/* registering code to run as system_server is for root only */
+		if (msg->uid != 0) {
+			PRT_TRACE_ERR("%d cannot add a predefine action",
+				      msg->pid);
+			ret = -1;
 			break;
+		}
+		ret = ss_predefine_plugin_add(msg);
+		break;
+	case CALL_SYSMAN_ACTION:
+		ret = ss_action_entry_call(msg, msg->argc, msg->argv);
+		break;
+	case CALL_SYSMAN_ACTION_WAIT:
+		ret = sysnoti_call_wait(client, msg);
+		break;
+	case OPEN_SYSMAN_SESSION:
+		ret = sysnoti_session_open(client);
+		break;
+	default:
+		ret = -1;
 	}
 
-	if (len <= 0) {
-		PRT_TRACE_ERR("str is null");
-		return NULL;
+	return ret;
+}
+
+static void sysnoti_reply(struct sysnoti_client *client, int ret)
+{
+	sysnoti_send(client, &ret, sizeof(int));
+}
+
+/* the timer only runs while some client has a deadline */
+static Eina_Bool sysnoti_sweep_cb(void *data)
+{
+	Eina_List *tmp;
+	Eina_List *tmp_next;
+	struct sysnoti_client *client;
+	double now = ecore_time_get();
+	int armed = 0;
+
+	EINA_LIST_FOREACH_SAFE(client_list, tmp, tmp_next, client) {
+		if (client->deadline == 0)
+			continue;
+		if (client->deadline > now) {
+			armed++;
+			continue;
+		}
+		PRT_TRACE_ERR("sysnoti request timeout on fd %d", client->fd);
+		if (!client->closing)
+			sysnoti_reply(client, -1);
+		/* still stuck on its queued replies, drop them */
+		if (client->closing)
+			sysnoti_out_free(client);
+		sysnoti_client_del(client);
 	}
 
-	if (len >= INT_MAX) {
-		PRT_TRACE_ERR("size is over INT_MAX");
-		return NULL;
+	if (armed == 0) {
+		sweep_timer = NULL;
+		return EINA_FALSE;
 	}
+	return EINA_TRUE;
+}
 
-	str = (char *)malloc(len + 1);
-	if (str == NULL) {
-		PRT_TRACE_ERR("Not enough memory");
-		return NULL;
+static int sysnoti_client_cb(void *data, Ecore_Fd_Handler * fd_handler)
+{
+	struct sysnoti_client *client = (struct sysnoti_client *)data;
+	struct sysnoti_parser *p = &client->parser;
+	char buf[SYSNOTI_RECV_SIZE];
+	int off = 0;
+	int len;
+	int r;
+
+	if (ecore_main_fd_handler_active_get(fd_handler, ECORE_FD_WRITE) &&
+	    (sysnoti_flush(client) < 0 ||
+	     (client->closing && client->out == NULL))) {
+		sysnoti_client_del(client);
+		return 1;
 	}
+	if (!ecore_main_fd_handler_active_get(fd_handler, ECORE_FD_READ))
+		return 1;
 
-	while(1) {
-		r = read(fd, str, len);
-		if(r < 0) {
-			if(errno == EINTR) {
-				PRT_TRACE_ERR("Re-read for error(EINTR)");
-				continue;                       
-			}                                               
-			else {      
-				PRT_TRACE_ERR("Read fail for str");
-				return NULL;
-			}                                                           
-		} else
+	len = read(client->fd, buf, sizeof(buf));
+	if (len < 0) {
+		if (errno == EINTR || errno == EAGAIN)
+			return 1;
+		PRT_TRACE_ERR("sysnoti read fail : %s", strerror(errno));
+		sysnoti_client_del(client);
+		return 1;
+	}
+
+	if (len == 0) {
+		/* a session client closing its socket is not an error */
+		if (sysnoti_parser_busy(p) || !client->persistent)
+			PRT_TRACE_ERR("%s : recv error msg", __FUNCTION__);
+		sysnoti_client_del(client);
+		return 1;
+	}
+
+	while (off < len) {
+		/* a one-shot client is still on its accept() deadline */
+		if (client->persistent && !sysnoti_parser_busy(p))
+			sysnoti_deadline_arm(client);
+
+		r = sysnoti_parse(p, buf + off, len - off);
+		if (r < 0) {
+			sysnoti_reply(client, -1);
+			sysnoti_client_del(client);
+			return 1;
+		}
+		off += r;
+
+		if (p->state != PARSE_DONE)
 			break;
+
+		sysnoti_reply(client, sysnoti_handle_msg(client, &p->msg));
+		sysnoti_parser_reset(p);
+		client->deadline = 0;
+
+		if (!client->persistent) {
+			/* keep the socket for the completion, stop reading */
+			if (client->pending > 0) {
+				client->reading = 0;
+				sysnoti_client_watch(client);
+			} else
+				sysnoti_client_del(client);
+			return 1;
+		}
 	}
-	str[len] = 0;
 
-	return str;
+	return 1;
 }
 
-static int read_message(int fd, struct sysnoti *msg)
+static const char *v2_str(const char *blob, int blob_len, uint16_t off)
 {
-	int i;
+	if (off == SYSNOTI_V2_NO_STR)
+		return NULL;
+	if (off >= blob_len || memchr(blob + off, 0, blob_len - off) == NULL)
+		return (const char *)-1;
+	return blob + off;
+}
 
-	msg->pid = recv_int(fd);
-	msg->cmd = recv_int(fd);
-	msg->type = recv_str(fd);
-	msg->path = recv_str(fd);
-	msg->argc = recv_int(fd);
+/*
+ * Point msgs into the frame; no copy and no allocation. Every string must
+ * be NUL-terminated inside the blob. Returns the number of records.
+ */
+static int sysnoti_v2_parse(const char *frame, int len,
+			    struct sysnoti *msgs)
+{
+	const struct sysnoti_v2_hdr *hdr = (const struct sysnoti_v2_hdr *)frame;
+	const struct sysnoti_v2_rec *rec;
+	const char *blob;
+	const char *str;
+	int i, n;
 
-	for (i = 0; i < msg->argc; i++)
-		msg->argv[i] = recv_str(fd);
+	if (len < sizeof(*hdr) || hdr->magic != SYSNOTI_V2_MAGIC)
+		return -EINVAL;
+	if (hdr->version != SYSNOTI_V2_VERSION)
+		return -EPROTONOSUPPORT;
+	if (hdr->nrec < 1 || hdr->nrec > SYSNOTI_V2_MAX_BATCH)
+		return -EINVAL;
+	if (hdr->nrec > 1 && hdr->cmd != CALL_SYSMAN_ACTION_BATCH)
+		return -EINVAL;
+	if (len != sizeof(*hdr) + hdr->nrec * sizeof(*rec) + hdr->blob_len)
+		return -EINVAL;
+
+	rec = (const struct sysnoti_v2_rec *)(hdr + 1);
+	blob = (const char *)(rec + hdr->nrec);
+
+	for (n = 0; n < hdr->nrec; n++, rec++) {
+		struct sysnoti *msg = &msgs[n];
+
+		if (rec->argc > SYSMAN_MAXARG || rec->argc > SYSNOTI_V2_MAXARG)
+			return -EINVAL;
+
+		msg->pid = hdr->pid;
+		msg->cmd = hdr->cmd;
+		msg->argc = rec->argc;
+
+		str = v2_str(blob, hdr->blob_len, rec->type_off);
+		if (str == (const char *)-1)
+			return -EINVAL;
+		msg->type = (char *)str;
+		str = v2_str(blob, hdr->blob_len, rec->path_off);
+		if (str == (const char *)-1)
+			return -EINVAL;
+		msg->path = (char *)str;
+		for (i = 0; i < rec->argc; i++) {
+			str = v2_str(blob, hdr->blob_len, rec->argv_off[i]);
+			if (str == (const char *)-1)
+				return -EINVAL;
+			msg->argv[i] = (char *)str;
+		}
+	}
+
+	return n;
+}
+
+struct sysnoti_stats_reply {
+	int32_t cnt;
+	int max;
+	struct sysnoti_action_stats *stats;
+};
 
+static int sysnoti_stats_add(struct ss_action_entry *act_entry, void *data)
+{
+	struct sysnoti_stats_reply *reply = data;
+
+	if (reply->cnt >= reply->max)
+		return -1;
+	reply->stats[reply->cnt++] = act_entry->stats;
 	return 0;
 }
 
-static inline void internal_free(char *str)
+/* the count and all records go out in one datagram, never a partial set */
+static void sysnoti_query_stats(struct sysnoti_client *client,
+				struct sysnoti *msg)
 {
-	if (!str)
-		free(str);
+	struct ss_action_entry *act_entry = NULL;
+	struct sysnoti_stats_reply reply;
+	char *buf;
+
+	if (msg->type && msg->type[0]) {
+		act_entry = ss_action_entry_find(msg->type);
+		reply.max = act_entry ? 1 : 0;
+	} else
+		reply.max = ss_action_entry_count();
+
+	buf = malloc(sizeof(int32_t) +
+		     reply.max * sizeof(struct sysnoti_action_stats));
+	if (buf == NULL) {
+		reply.cnt = -ENOMEM;
+		sysnoti_send(client, &reply.cnt, sizeof(reply.cnt));
+		return;
+	}
+
+	reply.cnt = 0;
+	reply.stats = (struct sysnoti_action_stats *)(buf + sizeof(int32_t));
+	if (act_entry)
+		sysnoti_stats_add(act_entry, &reply);
+	else if (reply.max > 0)
+		ss_action_entry_foreach(sysnoti_stats_add, &reply);
+
+	memcpy(buf, &reply.cnt, sizeof(int32_t));
+	sysnoti_send(client, buf, sizeof(int32_t) +
+		     reply.cnt * sizeof(struct sysnoti_action_stats));
+	free(buf);
 }
 
-static inline void free_message(struct sysnoti *msg)
+static void sysnoti_query_bg_lru(struct sysnoti_client *client)
 {
-	internal_free(msg->type);
-	internal_free(msg->path);
-	free(msg);
+	struct {
+		int32_t cnt;
+		struct sysnoti_bg_app apps[SYSNOTI_BG_LRU_MAX];
+	} reply;
+
+	reply.cnt = ss_procmgr_bg_lru(reply.apps, SYSNOTI_BG_LRU_MAX);
+	sysnoti_send(client, &reply, sizeof(reply.cnt) +
+		     reply.cnt * sizeof(struct sysnoti_bg_app));
 }
 
-static int sysnoti_cb(void *data, Ecore_Fd_Handler * fd_handler)
+static int sysnoti_v2_client_cb(void *data, Ecore_Fd_Handler * fd_handler)
+{
+	struct sysnoti_client *client = (struct sysnoti_client *)data;
+	int len;
+	int n, i;
+
+	if (ecore_main_fd_handler_active_get(fd_handler, ECORE_FD_WRITE) &&
+	    (sysnoti_flush(client) < 0 ||
+	     (client->closing && client->out == NULL))) {
+		sysnoti_client_del(client);
+		return 1;
+	}
+	if (!ecore_main_fd_handler_active_get(fd_handler, ECORE_FD_READ))
+		return 1;
+
+	len = recv(client->fd, v2_frame, sizeof(v2_frame), MSG_TRUNC);
+	if (len < 0) {
+		if (errno == EINTR || errno == EAGAIN)
+			return 1;
+		PRT_TRACE_ERR("sysnoti read fail : %s", strerror(errno));
+		sysnoti_client_del(client);
+		return 1;
+	}
+
+	if (len == 0) {
+		sysnoti_client_del(client);
+		return 1;
+	}
+
+	if (len > sizeof(v2_frame)) {
+		PRT_TRACE_ERR("sysnoti v2 frame too large (%d)", len);
+		sysnoti_reply(client, -EMSGSIZE);
+		return 1;
+	}
+
+	n = sysnoti_v2_parse(v2_frame, len, v2_msgs);
+	if (n < 0) {
+		sysnoti_reply(client, n);
+		return 1;
+	}
+
+	if (v2_msgs[0].cmd == CALL_SYSMAN_ACTION_BATCH) {
+		for (i = 0; i < n; i++) {
+			v2_msgs[i].pid = client->cred.pid;
+			v2_msgs[i].uid = client->cred.uid;
+			v2_msgs[i].gid = client->cred.gid;
+		}
+		client->seq++;
+		ss_action_entry_call_batch(v2_msgs, n, v2_results);
+		sysnoti_send(client, v2_results, n * sizeof(int));
+		return 1;
+	}
+
+	if (v2_msgs[0].cmd == QUERY_SYSMAN_STATS) {
+		sysnoti_query_stats(client, &v2_msgs[0]);
+		return 1;
+	}
+
+	if (v2_msgs[0].cmd == QUERY_SYSMAN_BG_LRU) {
+		sysnoti_query_bg_lru(client);
+		return 1;
+	}
+
+	sysnoti_reply(client, sysnoti_handle_msg(client, &v2_msgs[0]));
+	return 1;
+}
+
+static int sysnoti_accept(Ecore_Fd_Handler * fd_handler, int seqpacket)
 {
 	int fd;
-	struct sysnoti *msg;
-	int ret = -1;
 	struct sockaddr_un client_address;
+	struct sysnoti_client *client;
+	struct ucred cred;
+	socklen_t cred_len = sizeof(cred);
 	int client_sockfd;
 	int client_len;
 
@@ -172,12 +968,6 @@ static int sysnoti_cb(void *data, Ecore_Fd_Handler * fd_handler)
 
 	fd = ecore_main_fd_handler_fd_get(fd_handler);
 
-	msg = malloc(sizeof(struct sysnoti));
-	if (msg == NULL) {
-		PRT_TRACE_ERR("%s : Not enough memory", __FUNCTION__);
-		return 1;
-	}
-
 	client_len = sizeof(client_address);
 	client_sockfd =
 	    accept(fd, (struct sockaddr *)&client_address,
@@ -187,48 +977,91 @@ static int sysnoti_cb(void *data, Ecore_Fd_Handler * fd_handler)
 		return 1;
 	}
 
-	if (read_message(client_sockfd, msg) < 0) {
-		PRT_TRACE_ERR("%s : recv error msg", __FUNCTION__);
-		free(msg);
-		write(client_sockfd, &ret, sizeof(int));
+	if (getsockopt(client_sockfd, SOL_SOCKET, SO_PEERCRED, &cred,
+		       &cred_len) < 0) {
+		PRT_TRACE_ERR("socket peer credential error");
 		close(client_sockfd);
 		return 1;
 	}
 
-	print_sysnoti_msg(__FUNCTION__, msg);
-	if (msg->argc > SYSMAN_MAXARG) {
-		PRT_TRACE_ERR("%s : error argument", __FUNCTION__);
-		free_message(msg);
-		write(client_sockfd, &ret, sizeof(int));
+	if (seqpacket && session_cnt >= SYSNOTI_MAX_SESSIONS) {
+		PRT_TRACE_ERR("too many sysnoti sessions (%d)", session_cnt);
 		close(client_sockfd);
 		return 1;
 	}
 
-	switch (msg->cmd) {
-	case CALL_SYSMAN_ACTION:
-		ret = ss_action_entry_call(msg, msg->argc, msg->argv);
-		break;
-	default:
-		ret = -1;
+	if (!seqpacket && oneshot_cnt >= SYSNOTI_MAX_CLIENTS) {
+		PRT_TRACE_ERR("too many sysnoti clients (%d)", oneshot_cnt);
+		close(client_sockfd);
+		return 1;
+	}
+
+	if (fcntl(client_sockfd, F_SETFL, O_NONBLOCK) < 0) {
+		PRT_TRACE_ERR("socket nonblock set error");
+		close(client_sockfd);
+		return 1;
 	}
 
-	write(client_sockfd, &ret, sizeof(int));
-	close(client_sockfd);
+	client = malloc(sizeof(struct sysnoti_client));
+	if (client == NULL) {
+		PRT_TRACE_ERR("%s : Not enough memory", __FUNCTION__);
+		close(client_sockfd);
+		return 1;
+	}
+
+	client->fd = client_sockfd;
+	client->cred = cred;
+	client->persistent = seqpacket;
+	client->seqpacket = seqpacket;
+	client->seq = 0;
+	client->pending = 0;
+	client->deadline = 0;
+	client->reading = 1;
+	client->closing = 0;
+	client->out = NULL;
+	client->out_bytes = 0;
+	sysnoti_parser_reset(&client->parser);
+	client->handler =
+	    ecore_main_fd_handler_add(client_sockfd, ECORE_FD_READ,
+				      seqpacket ? sysnoti_v2_client_cb :
+				      sysnoti_client_cb, client, NULL, NULL);
+	if (client->handler == NULL) {
+		PRT_TRACE_ERR("%s : fd handler add failed", __FUNCTION__);
+		close(client_sockfd);
+		free(client);
+		return 1;
+	}
 
-	free_message(msg);
+	client_list = eina_list_prepend(client_list, client);
+	if (seqpacket)
+		session_cnt++;
+	else {
+		oneshot_cnt++;
+		sysnoti_deadline_arm(client);
+	}
 
 	return 1;
 }
 
-static int ss_sysnoti_server_init(void)
+static int sysnoti_cb(void *data, Ecore_Fd_Handler * fd_handler)
+{
+	return sysnoti_accept(fd_handler, 0);
+}
+
+static int sysnoti_v2_cb(void *data, Ecore_Fd_Handler * fd_handler)
+{
+	return sysnoti_accept(fd_handler, 1);
+}
+
+static int ss_sysnoti_server_init(const char *path, int type)
 {
 	int fd;
 	struct sockaddr_un serveraddr;
 
-	if (access(SYSNOTI_SOCKET_PATH, F_OK) == 0)
-		unlink(SYSNOTI_SOCKET_PATH);
+	if (access(path, F_OK) == 0)
+		unlink(path);
 
-	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	fd = socket(AF_UNIX, type, 0);
 	if (fd < 0) {
 		PRT_ERR("%s: socket create failed\n", __FUNCTION__);
 		return -1;
@@ -248,8 +1081,7 @@ static int ss_sysnoti_server_init(void)
 
 	bzero(&serveraddr, sizeof(struct sockaddr_un));
 	serveraddr.sun_family = AF_UNIX;
-	strncpy(serveraddr.sun_path, SYSNOTI_SOCKET_PATH,
-		sizeof(serveraddr.sun_path));
+	strncpy(serveraddr.sun_path, path, sizeof(serveraddr.sun_path));
 
 	if (bind(fd, (struct sockaddr *)&serveraddr, sizeof(struct sockaddr)) <
 	    0) {
@@ -257,7 +1089,7 @@ static int ss_sysnoti_server_init(void)
 		return -1;
 	}
 
-	if (chmod(SYSNOTI_SOCKET_PATH, (S_IRWXU | S_IRWXG | S_IRWXO)) < 0)	/* 0777 */
+	if (chmod(path, (S_IRWXU | S_IRWXG | S_IRWXO)) < 0)	/* 0777 */
 		PRT_ERR("failed to change the socket permission");
 
 	listen(fd, 5);
@@ -270,8 +1102,23 @@ static int ss_sysnoti_server_init(void)
 int ss_sysnoti_init(void)
 {
 	int fd;
-	fd = ss_sysnoti_server_init();
+	int v2_fd;
+
+	fd = ss_sysnoti_server_init(SYSNOTI_SOCKET_PATH, SOCK_STREAM);
 	ecore_main_fd_handler_add(fd, ECORE_FD_READ, sysnoti_cb, NULL, NULL,
 				  NULL);
+
+	if (vconf_get_int(VCONFKEY_INTERNAL_SYSNOTI_TRACE,
+			  &sysnoti_trace_level) != 0)
+		sysnoti_trace_level = SYSNOTI_TRACE_OFF;
+	vconf_notify_key_changed(VCONFKEY_INTERNAL_SYSNOTI_TRACE,
+				 (void *)sysnoti_trace_changed, NULL);
+
+	v2_fd = ss_sysnoti_server_init(SYSNOTI_V2_SOCKET_PATH, SOCK_SEQPACKET);
+	if (v2_fd < 0)
+		PRT_TRACE_ERR("sysnoti v2 socket init failed");
+	else
+		ecore_main_fd_handler_add(v2_fd, ECORE_FD_READ, sysnoti_v2_cb,
+					  NULL, NULL, NULL);
 	return fd;
 }
@@ -18,10 +18,14 @@
 #ifndef __SS_SYSNOTI_H__
 #define __SS_SYSNOTI_H__
 
+#include <sys/types.h>
+
 #define SYSMAN_MAXARG	16
 
 struct sysnoti {
 	int pid;
+	uid_t uid;
+	gid_t gid;
 	int cmd;
 	char *type;
 	char *path;
@@ -30,5 +34,6 @@ struct sysnoti {
 };
 
 int ss_sysnoti_init(void);
+void ss_sysnoti_forget_pid(int pid);
 
 #endif /* __SS_SYSNOTI_H__ */
@@ -29,6 +29,7 @@
 #include <limits.h>
 #include <syspopup_caller.h>
 #include "ss_device_handler.h"
+#include "ss_queue.h"
 #include "ss_log.h"
 
 #define BUF_MAX			512     
@@ -0,0 +1,142 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+
+#include <signal.h>
+#include <Ecore.h>
+#include "ss_log.h"
+#include "ss_queue.h"
+#include "ss_watchdog.h"
+
+/*
+ * Forked children of running entries are watched by a single timer
+ * wheel. The ecore timer only runs while something is armed; an entry
+ * whose timeout is longer than one turn of the wheel waits out
+ * wd_rounds turns in its slot.
+ */
+#define WD_TICK		0.5	/* seconds */
+#define WD_SLOTS	64
+
+enum wd_stage {
+	WD_STAGE_TERM,		/* next expiry sends SIGTERM */
+	WD_STAGE_KILL,		/* next expiry sends SIGKILL */
+	WD_STAGE_DONE
+};
+
+static struct ss_run_queue_entry *wd_wheel[WD_SLOTS];
+static unsigned int wd_now;
+static int wd_armed;
+static Ecore_Timer *wd_timer;
+
+static Eina_Bool wd_tick_cb(void *data);
+
+static void wd_link(struct ss_run_queue_entry *rq_entry, double timeout)
+{
+	unsigned int ticks;
+	struct ss_run_queue_entry **slot;
+
+	ticks = (unsigned int)(timeout / WD_TICK + 0.999);
+	if (ticks < 1)
+		ticks = 1;
+
+	slot = &wd_wheel[(wd_now + ticks) % WD_SLOTS];
+	rq_entry->wd_rounds = (ticks - 1) / WD_SLOTS;
+	rq_entry->wd_next = *slot;
+	rq_entry->wd_pprev = slot;
+	if (*slot)
+		(*slot)->wd_pprev = &rq_entry->wd_next;
+	*slot = rq_entry;
+
+	if (wd_armed++ == 0 && wd_timer == NULL)
+		wd_timer = ecore_timer_add(WD_TICK, wd_tick_cb, NULL);
+}
+
+static void wd_unlink(struct ss_run_queue_entry *rq_entry)
+{
+	*rq_entry->wd_pprev = rq_entry->wd_next;
+	if (rq_entry->wd_next)
+		rq_entry->wd_next->wd_pprev = rq_entry->wd_pprev;
+	rq_entry->wd_next = NULL;
+	rq_entry->wd_pprev = NULL;
+	wd_armed--;
+}
+
+static void wd_expire(struct ss_run_queue_entry *rq_entry)
+{
+	struct ss_action_entry *act_entry = rq_entry->action_entry;
+	int pid = rq_entry->forked_pid;
+
+	switch (rq_entry->wd_stage) {
+	case WD_STAGE_TERM:
+		act_entry->stats.timeouts++;
+		PRT_TRACE_ERR("[SYSMAN] %s (pid %d) timed out, terminating",
+			      act_entry->type, pid);
+		kill(pid, SIGTERM);
+		rq_entry->wd_stage = WD_STAGE_KILL;
+		wd_link(rq_entry, SS_WD_KILL_GRACE);
+		break;
+	case WD_STAGE_KILL:
+		PRT_TRACE_ERR("[SYSMAN] %s (pid %d) ignored SIGTERM, killing",
+			      act_entry->type, pid);
+		kill(pid, SIGKILL);
+		rq_entry->wd_stage = WD_STAGE_DONE;
+		break;
+	default:
+		break;
+	}
+}
+
+static Eina_Bool wd_tick_cb(void *data)
+{
+	struct ss_run_queue_entry *rq_entry;
+	struct ss_run_queue_entry *next;
+
+	wd_now++;
+	rq_entry = wd_wheel[wd_now % WD_SLOTS];
+	for (; rq_entry; rq_entry = next) {
+		next = rq_entry->wd_next;
+		if (rq_entry->wd_rounds > 0) {
+			rq_entry->wd_rounds--;
+			continue;
+		}
+		wd_unlink(rq_entry);
+		wd_expire(rq_entry);
+	}
+
+	if (wd_armed == 0) {
+		wd_timer = NULL;
+		return EINA_FALSE;
+	}
+	return EINA_TRUE;
+}
+
+/* start watching the forked child of a running entry */
+void ss_watchdog_arm(struct ss_run_queue_entry *rq_entry, double timeout)
+{
+	if (timeout <= 0 || rq_entry->forked_pid <= 0)
+		return;
+
+	if (rq_entry->wd_pprev)
+		wd_unlink(rq_entry);
+	rq_entry->wd_stage = WD_STAGE_TERM;
+	wd_link(rq_entry, timeout);
+}
+
+void ss_watchdog_disarm(struct ss_run_queue_entry *rq_entry)
+{
+	if (rq_entry->wd_pprev)
+		wd_unlink(rq_entry);
+}
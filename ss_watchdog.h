@@ -0,0 +1,28 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+
+#ifndef __SS_WATCHDOG_H__
+#define __SS_WATCHDOG_H__
+
+#include "ss_queue.h"
+
+#define SS_WD_KILL_GRACE	3	/* seconds from SIGTERM to SIGKILL */
+
+void ss_watchdog_arm(struct ss_run_queue_entry *rq_entry, double timeout);
+void ss_watchdog_disarm(struct ss_run_queue_entry *rq_entry);
+
+#endif /* __SS_WATCHDOG_H__ */
@@ -0,0 +1,210 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+/*
+ * Stress check for the legacy sysnoti socket: a client that drips its
+ * request one byte at a time, or sends nothing at all, must be dropped
+ * by the server while other clients keep being answered.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <ss_sysnoti_proto.h>
+
+/* server request timeout is 3 s, swept once a second */
+#define DRIP_LIMIT		6.0
+#define DRIP_INTERVAL_MS	250
+#define PROBE_TIMEOUT_MS	1000
+#define PROBE_TYPE		"sys_drip_probe"
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int sn_connect(void)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, SYSNOTI_SOCKET_PATH,
+		sizeof(addr.sun_path) - 1);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static char *put_int(char *p, int val)
+{
+	memcpy(p, &val, sizeof(val));
+	return p + sizeof(val);
+}
+
+/* CALL_SYSMAN_ACTION of an action that does not exist, answered -1 */
+static int build_req(char *buf)
+{
+	int len = strlen(PROBE_TYPE);
+	char *p = buf;
+
+	p = put_int(p, getpid());
+	p = put_int(p, CALL_SYSMAN_ACTION);
+	p = put_int(p, len);
+	memcpy(p, PROBE_TYPE, len);
+	p += len;
+	p = put_int(p, 0);	/* path */
+	p = put_int(p, 0);	/* argc */
+	return p - buf;
+}
+
+/* a complete request on a fresh connection must be answered in time */
+static int probe(void)
+{
+	struct pollfd pfd;
+	char req[64];
+	int len, ret;
+	int fd;
+
+	fd = sn_connect();
+	if (fd < 0)
+		return -1;
+
+	len = build_req(req);
+	if (send(fd, req, len, MSG_NOSIGNAL) != len) {
+		close(fd);
+		return -1;
+	}
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, PROBE_TIMEOUT_MS) != 1 ||
+	    recv(fd, &ret, sizeof(ret), 0) != sizeof(ret)) {
+		close(fd);
+		return -1;
+	}
+
+	close(fd);
+	return 0;
+}
+
+/* the server closed the connection, possibly after a -1 reply */
+static int dropped(int fd)
+{
+	struct pollfd pfd;
+	char buf[16];
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, 0) != 1)
+		return 0;
+	return recv(fd, buf, sizeof(buf), MSG_DONTWAIT) >= 0 ||
+	    errno == ECONNRESET;
+}
+
+/*
+ * Send up to drip bytes of a request, one every DRIP_INTERVAL_MS, and
+ * probe the server in between. Returns the seconds until the drop.
+ */
+static double run(const char *name, int drip)
+{
+	char req[64];
+	double start, last_probe = 0;
+	int len, sent = 0;
+	int fd;
+
+	fd = sn_connect();
+	if (fd < 0) {
+		perror(SYSNOTI_SOCKET_PATH);
+		return -1;
+	}
+
+	len = build_req(req);
+	if (drip > len - 1)
+		drip = len - 1;
+
+	start = now();
+	for (;;) {
+		if (now() - start > DRIP_LIMIT) {
+			printf("%s: FAIL, still connected after %.1f s\n",
+			       name, DRIP_LIMIT);
+			close(fd);
+			return -1;
+		}
+		if (sent < drip) {
+			if (send(fd, req + sent, 1, MSG_NOSIGNAL) < 0)
+				break;
+			sent++;
+		}
+		if (dropped(fd))
+			break;
+		if (now() - last_probe >= 1.0) {
+			if (probe() < 0) {
+				printf("%s: FAIL, server stopped answering\n",
+				       name);
+				close(fd);
+				return -1;
+			}
+			last_probe = now();
+		}
+		usleep(DRIP_INTERVAL_MS * 1000);
+	}
+
+	close(fd);
+	start = now() - start;
+	printf("%s: ok, dropped after %.1f s, %d bytes sent\n", name, start,
+	       sent);
+	return start;
+}
+
+int main(int argc, char **argv)
+{
+	int fail = 0;
+
+	if (argc != 1) {
+		printf("[usage] %s\n", argv[0]);
+		return -1;
+	}
+
+	if (probe() < 0) {
+		printf("%s is not answering\n", SYSNOTI_SOCKET_PATH);
+		return -1;
+	}
+
+	if (run("drip", 1 << 16) < 0)
+		fail = 1;
+	if (run("idle", 0) < 0)
+		fail = 1;
+
+	printf("%s\n", fail ? "FAIL" : "PASS");
+	return fail ? -1 : 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <ss_memsnap_file.h>
+
+static char slot[MEMSNAP_SLOT_SIZE] __attribute__ ((aligned(8)));
+
+/* one snapshot, laid out like the memps output */
+static void print_slot(const struct memsnap_hdr *hdr)
+{
+	const struct memsnap_proc *proc =
+	    (const struct memsnap_proc *)(hdr + 1);
+	unsigned long rss = 0, pss = 0, swap = 0;
+	char when[32];
+	time_t t = hdr->time;
+	struct tm tm;
+	uint32_t i;
+
+	strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S",
+		 localtime_r(&t, &tm));
+	printf("==== #%u %s %s victim %d (%u us)\n", hdr->seq, when,
+	       hdr->reason, hdr->victim_pid, hdr->duration_us);
+	printf("MemTotal %u kB, MemAvailable %u kB\n", hdr->mem_total_kb,
+	       hdr->mem_avail_kb);
+	printf("%8s %6s %10s %10s %10s  %s\n", "PID", "OOM", "RSS", "PSS",
+	       "SWAP", "COMMAND");
+
+	for (i = 0; i < hdr->count && i < MEMSNAP_MAX_PROCS; i++) {
+		printf("%8d %6d %10u %10u %10u  %.*s\n", proc[i].pid,
+		       proc[i].oom_score_adj, proc[i].rss_kb, proc[i].pss_kb,
+		       proc[i].swap_kb, MEMSNAP_NAME_LEN, proc[i].name);
+		rss += proc[i].rss_kb;
+		pss += proc[i].pss_kb;
+		swap += proc[i].swap_kb;
+	}
+	printf("%8s %6s %10lu %10lu %10lu\n", "TOTAL", "", rss, pss, swap);
+	if (hdr->skipped)
+		printf("partial snapshot: %u more processes not recorded\n",
+		       hdr->skipped);
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct memsnap_file_hdr file;
+	struct memsnap_hdr *hdr = (struct memsnap_hdr *)slot;
+	const char *path = MEMSNAP_FILE;
+	uint32_t i, n;
+	int fd;
+
+	if (argc == 3 && !strcmp(argv[1], "-f"))
+		path = argv[2];
+	else if (argc != 1) {
+		printf("[usage] sys_memsnap [-f file]\n");
+		return -1;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+
+	if (read(fd, &file, sizeof(file)) != sizeof(file) ||
+	    file.magic != MEMSNAP_MAGIC || file.version != MEMSNAP_VERSION ||
+	    file.slot_size != MEMSNAP_SLOT_SIZE || file.slots == 0) {
+		printf("%s: not a memory snapshot file\n", path);
+		close(fd);
+		return -1;
+	}
+
+	/* oldest first, starting at the slot written next */
+	for (i = 0; i < file.slots; i++) {
+		n = (file.next + i) % file.slots;
+		if (pread(fd, slot, sizeof(slot), sizeof(file) +
+			  (off_t)n * file.slot_size) <
+		    (ssize_t)sizeof(struct memsnap_hdr) || hdr->seq == 0)
+			continue;
+		print_slot(hdr);
+	}
+
+	close(fd);
+	return 0;
+}
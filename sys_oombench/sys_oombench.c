@@ -0,0 +1,262 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+/*
+ * Fills /proc with idle children, a few of them in the background oom
+ * range, and times one aging round the way check_and_set_old_backgrd
+ * used to do it, two passes over every oom file in /proc, against the
+ * pid table, which only rewrites the background apps through fds it
+ * keeps open. Also times an oom_adj lookup with and without the cached
+ * fd.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define BG_SCORE	100	/* what the children in the background get */
+
+struct bench_proc {
+	int pid;
+	int oomfd;		/* only opened for the table */
+};
+
+static struct bench_proc *procs;
+static int nr_procs = 2000;
+static int nr_bg = 15;		/* sum of the default aging tiers */
+static int rounds = 20;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int oom_path_read(int pid, char *buf, int size)
+{
+	char path[64];
+	int fd, len;
+
+	snprintf(path, sizeof(path), "/proc/%d/oom_score_adj", pid);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	len = read(fd, buf, size - 1);
+	close(fd);
+	if (len <= 0)
+		return -1;
+	buf[len] = '\0';
+	return 0;
+}
+
+static int spawn(void)
+{
+	int i, fd, pid;
+
+	procs = calloc(nr_procs, sizeof(struct bench_proc));
+	if (procs == NULL)
+		return -1;
+
+	for (i = 0; i < nr_procs; i++) {
+		pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			nr_procs = i;
+			return -1;
+		}
+		if (pid == 0) {
+			if (i < nr_bg) {
+				fd = open("/proc/self/oom_score_adj", O_WRONLY);
+				if (fd >= 0 && write(fd, "100", 3) < 0)
+					_exit(1);
+			}
+			pause();
+			_exit(0);
+		}
+		procs[i].pid = pid;
+		procs[i].oomfd = -1;
+	}
+	return 0;
+}
+
+static void reap(void)
+{
+	int i;
+
+	for (i = 0; i < nr_procs; i++) {
+		kill(procs[i].pid, SIGKILL);
+		if (procs[i].oomfd >= 0)
+			close(procs[i].oomfd);
+	}
+	for (i = 0; i < nr_procs; i++)
+		waitpid(procs[i].pid, NULL, 0);
+	free(procs);
+}
+
+/* one pass over /proc; rewrite the background ones when write is set */
+static int scan_pass(int write_bg, long *opens)
+{
+	DIR *dp;
+	struct dirent *dentry;
+	char path[64], buf[16];
+	int fd, len, bg = 0;
+
+	dp = opendir("/proc");
+	if (dp == NULL)
+		return -1;
+	while ((dentry = readdir(dp)) != NULL) {
+		if (!isdigit(dentry->d_name[0]))
+			continue;
+		snprintf(path, sizeof(path), "/proc/%d/oom_score_adj",
+			 atoi(dentry->d_name));
+		fd = open(path, O_RDWR | O_CLOEXEC);
+		if (fd < 0)
+			fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			continue;
+		(*opens)++;
+		len = read(fd, buf, sizeof(buf) - 1);
+		if (len > 0) {
+			buf[len] = '\0';
+			if (atoi(buf) >= BG_SCORE) {
+				bg++;
+				if (write_bg &&
+				    pwrite(fd, buf, len, 0) != len)
+					bg--;
+			}
+		}
+		close(fd);
+	}
+	closedir(dp);
+	return bg;
+}
+
+static double bench_scan(long *opens)
+{
+	double start = now();
+	int i;
+
+	for (i = 0; i < rounds; i++) {
+		if (scan_pass(0, opens) > 0)
+			scan_pass(1, opens);
+	}
+	return (now() - start) / rounds;
+}
+
+static double bench_table(void)
+{
+	char path[64], buf[16];
+	double start;
+	int i, r, len;
+
+	for (i = 0; i < nr_bg; i++) {
+		snprintf(path, sizeof(path), "/proc/%d/oom_score_adj",
+			 procs[i].pid);
+		procs[i].oomfd = open(path, O_RDWR | O_CLOEXEC);
+		if (procs[i].oomfd < 0)
+			return -1;
+	}
+
+	start = now();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < nr_bg; i++) {
+			len = snprintf(buf, sizeof(buf), "%d", BG_SCORE);
+			if (pwrite(procs[i].oomfd, buf, len, 0) != len)
+				return -1;
+		}
+	}
+	return (now() - start) / rounds;
+}
+
+/* get_app_oomadj on every pid: open/read/close against a cached pread */
+static void bench_lookup(double *open_us, double *pread_us)
+{
+	char buf[16];
+	double start;
+	int i, n = nr_bg;
+
+	start = now();
+	for (i = 0; i < n; i++)
+		oom_path_read(procs[i].pid, buf, sizeof(buf));
+	*open_us = (now() - start) / n * 1e6;
+
+	start = now();
+	for (i = 0; i < n; i++)
+		pread(procs[i].oomfd, buf, sizeof(buf) - 1, 0);
+	*pread_us = (now() - start) / n * 1e6;
+}
+
+int main(int argc, char **argv)
+{
+	double scan, table, open_us, pread_us;
+	long opens = 0;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			nr_procs = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+			nr_bg = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			rounds = atoi(argv[++i]);
+		else {
+			printf("[usage] sys_oombench [-n processes] "
+			       "[-b background] [-r rounds]\n");
+			return -1;
+		}
+	}
+	if (nr_procs < 1 || nr_bg < 1 || nr_bg > nr_procs || rounds < 1) {
+		printf("need 1 <= background <= processes and rounds > 0\n");
+		return -1;
+	}
+
+	if (spawn() < 0) {
+		reap();
+		return -1;
+	}
+
+	scan = bench_scan(&opens);
+	table = bench_table();
+	if (table < 0) {
+		printf("cannot write the oom file of a child\n");
+		reap();
+		return -1;
+	}
+	bench_lookup(&open_us, &pread_us);
+
+	printf("%d processes, %d in the background, %d rounds\n", nr_procs,
+	       nr_bg, rounds);
+	printf("  /proc scan: %.3f ms per round, %ld opens per round\n",
+	       scan * 1e3, opens / rounds);
+	printf("  pid table:  %.3f ms per round, %d writes per round\n",
+	       table * 1e3, nr_bg);
+	printf("  lookup:     %.2f us open/read/close, %.2f us pread\n",
+	       open_us, pread_us);
+
+	reap();
+	return 0;
+}
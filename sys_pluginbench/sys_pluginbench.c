@@ -0,0 +1,154 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+/*
+ * Times what registering the predefine plugins costs at boot: the
+ * directory scan system_server does now, which only checks that each
+ * lib<type>.so is readable, against the dlopen() and symbol lookup of
+ * every plugin it used to do. Also reports the resident memory the
+ * loaded plugins take.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <limits.h>
+#include <time.h>
+
+#define PREDEFINE_SO_DIR	PREFIX"/lib/ss_predefine/"
+
+static const char *plugin_sym[] = {
+	"ss_predefine_action",
+	"ss_is_accessable",
+	"ss_ui_viewable",
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long rss_kb(void)
+{
+	char line[128];
+	FILE *fp;
+	long kb = -1;
+
+	fp = fopen("/proc/self/status", "r");
+	if (fp == NULL)
+		return -1;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "VmRSS: %ld", &kb) == 1)
+			break;
+	}
+	fclose(fp);
+	return kb;
+}
+
+static int is_plugin(const char *name)
+{
+	const char *ext = strstr(name, ".so");
+
+	return strncmp(name, "lib", 3) == 0 && ext != NULL &&
+	    strcmp(ext, ".so") == 0 && ext - name > 3;
+}
+
+/* one pass over the directory, dlopen()ing every plugin if load is set */
+static int scan(const char *dir, int load, void ***handles)
+{
+	DIR *dp;
+	struct dirent *dentry;
+	char path[PATH_MAX];
+	void *handle, **tmp;
+	int cnt = 0;
+	unsigned int i;
+
+	dp = opendir(dir);
+	if (dp == NULL)
+		return -1;
+	while ((dentry = readdir(dp)) != NULL) {
+		if (!is_plugin(dentry->d_name))
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, dentry->d_name);
+		if (access(path, R_OK) != 0)
+			continue;
+		if (load) {
+			handle = dlopen(path, RTLD_LAZY);
+			if (handle == NULL) {
+				printf("%s\n", dlerror());
+				continue;
+			}
+			for (i = 0; i < sizeof(plugin_sym) / sizeof(char *); i++)
+				dlsym(handle, plugin_sym[i]);
+			tmp = realloc(*handles, (cnt + 1) * sizeof(void *));
+			if (tmp == NULL) {
+				dlclose(handle);
+				break;
+			}
+			*handles = tmp;
+			(*handles)[cnt] = handle;
+		}
+		cnt++;
+	}
+	closedir(dp);
+	return cnt;
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = PREDEFINE_SO_DIR;
+	void **handles = NULL;
+	double start, scan_ms, load_ms;
+	long rss;
+	int cnt, loaded, i;
+
+	if (argc > 2) {
+		printf("[usage] %s [plugin dir]\n", argv[0]);
+		return -1;
+	}
+	if (argc == 2)
+		dir = argv[1];
+
+	start = now();
+	cnt = scan(dir, 0, NULL);
+	scan_ms = (now() - start) * 1000;
+	if (cnt < 0) {
+		perror(dir);
+		return -1;
+	}
+
+	rss = rss_kb();
+	start = now();
+	loaded = scan(dir, 1, &handles);
+	load_ms = (now() - start) * 1000;
+	rss = rss_kb() - rss;
+
+	printf("%d plugins in %s\n", cnt, dir);
+	printf("  register only: %.3f ms\n", scan_ms);
+	printf("  dlopen all:    %.3f ms, %d loaded, +%ld kB resident\n",
+	       load_ms, loaded, rss);
+
+	for (i = 0; i < loaded; i++)
+		dlclose(handles[i]);
+	free(handles);
+	return 0;
+}
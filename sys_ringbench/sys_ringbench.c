@@ -0,0 +1,175 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+/*
+ * Floods the core command ring from several threads, the way workers and
+ * sysnoti post RUN and CLEAR commands, and reports throughput and how
+ * many main loop wakeups it took. -p runs the same load over the pipe
+ * the core used before, one read per wakeup.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <ss_core_ring.h>
+
+static struct core_ring ring;
+static int wake_fd = -1;	/* eventfd, or the pipe write end */
+static int read_fd = -1;
+static int use_pipe;
+static int per_thread = 100000;
+static volatile unsigned int ring_full;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *producer(void *data)
+{
+	struct _internal_msg msg;
+	uint64_t one = 1;
+	int i;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.pid = (int)(intptr_t)data;
+	for (i = 0; i < per_thread; i++) {
+		msg.status = i;
+		if (use_pipe) {
+			if (write(wake_fd, &msg, sizeof(msg)) != sizeof(msg))
+				break;
+			continue;
+		}
+		/* the core drops a command on a full ring, count and retry */
+		while (core_ring_push(&ring, &msg) < 0) {
+			__sync_fetch_and_add(&ring_full, 1);
+			sched_yield();
+		}
+		if (write(wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+			break;
+	}
+	return NULL;
+}
+
+/* the main loop side, returns the number of wakeups */
+static unsigned long consume(unsigned long total)
+{
+	struct _internal_msg msg;
+	struct pollfd pfd;
+	unsigned long got = 0, wakeups = 0;
+	uint64_t cnt;
+
+	pfd.fd = read_fd;
+	pfd.events = POLLIN;
+	while (got < total) {
+		if (poll(&pfd, 1, 1000) != 1) {
+			fprintf(stderr, "stalled at %lu of %lu\n", got, total);
+			break;
+		}
+		wakeups++;
+		if (use_pipe) {
+			/* core_pipe_cb read one command per wakeup */
+			if (read(read_fd, &msg, sizeof(msg)) == sizeof(msg))
+				got++;
+			continue;
+		}
+		if (read(read_fd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+			break;
+		while (core_ring_pop(&ring, &msg))
+			got++;
+	}
+	return wakeups;
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t *tid;
+	int threads = 4;
+	unsigned long total, wakeups;
+	int pfd[2];
+	double start, sec;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-p"))
+			use_pipe = 1;
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			per_thread = atoi(argv[++i]);
+		else {
+			printf("[usage] sys_ringbench [-p] [-t threads] "
+			       "[-n msgs per thread]\n");
+			return -1;
+		}
+	}
+	if (threads < 1 || per_thread < 1) {
+		printf("threads and msgs must be positive\n");
+		return -1;
+	}
+
+	if (use_pipe) {
+		if (pipe(pfd) < 0) {
+			perror("pipe");
+			return -1;
+		}
+		read_fd = pfd[0];
+		wake_fd = pfd[1];
+	} else {
+		core_ring_init(&ring);
+		read_fd = wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (read_fd < 0) {
+			perror("eventfd");
+			return -1;
+		}
+	}
+
+	tid = calloc(threads, sizeof(pthread_t));
+	if (tid == NULL)
+		return -1;
+
+	total = (unsigned long)threads * per_thread;
+	start = now();
+	for (i = 0; i < threads; i++)
+		pthread_create(&tid[i], NULL, producer, (void *)(intptr_t)i);
+	wakeups = consume(total);
+	for (i = 0; i < threads; i++)
+		pthread_join(tid[i], NULL);
+	sec = now() - start;
+
+	printf("%s: %d threads x %d msgs in %.3f s, %.0f msgs/s\n",
+	       use_pipe ? "pipe" : "ring", threads, per_thread, sec,
+	       total / sec);
+	printf("  %lu wakeups, %.1f msgs per wakeup", wakeups,
+	       wakeups ? (double)total / wakeups : 0);
+	if (!use_pipe)
+		printf(", ring full %u times", ring_full);
+	printf("\n");
+
+	free(tid);
+	return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <ss_sysnoti_proto.h>
+
+static const char *hist_name[SYSNOTI_HIST_MAX] = {
+	[SYSNOTI_HIST_WAIT] = "wait",
+	[SYSNOTI_HIST_RUN] = "run",
+	[SYSNOTI_HIST_CHILD] = "child",
+};
+
+/* upper bound in usec of the bucket holding the given percentile */
+static unsigned long hist_percentile(const uint32_t *hist, int pct)
+{
+	unsigned long total = 0, sum = 0;
+	int i;
+
+	for (i = 0; i < SYSNOTI_HIST_BUCKETS; i++)
+		total += hist[i];
+	if (total == 0)
+		return 0;
+
+	for (i = 0; i < SYSNOTI_HIST_BUCKETS; i++) {
+		sum += hist[i];
+		if (sum * 100 >= total * pct)
+			break;
+	}
+	if (i >= SYSNOTI_HIST_BUCKETS)
+		i = SYSNOTI_HIST_BUCKETS - 1;
+	return 2UL << i;
+}
+
+static void print_stats(const struct sysnoti_action_stats *st, int verbose)
+{
+	int h, i;
+
+	printf("%-24s calls %u  timeouts %u\n", st->type, st->calls,
+	       st->timeouts);
+	for (h = 0; h < SYSNOTI_HIST_MAX; h++) {
+		printf("  %-6s p50 <%lu us  p90 <%lu us  p99 <%lu us\n",
+		       hist_name[h], hist_percentile(st->hist[h], 50),
+		       hist_percentile(st->hist[h], 90),
+		       hist_percentile(st->hist[h], 99));
+		if (!verbose)
+			continue;
+		for (i = 0; i < SYSNOTI_HIST_BUCKETS; i++) {
+			if (st->hist[h][i])
+				printf("    <%-10lu %u\n", 2UL << i,
+				       st->hist[h][i]);
+		}
+	}
+}
+
+static int query(int fd, int cmd, const char *type)
+{
+	char frame[SYSNOTI_V2_MAX_FRAME];
+	struct sysnoti_v2_hdr *hdr = (struct sysnoti_v2_hdr *)frame;
+	struct sysnoti_v2_rec *rec = (struct sysnoti_v2_rec *)(hdr + 1);
+	char *blob = (char *)(rec + 1);
+	int len = 0;
+
+	memset(frame, 0, sizeof(frame));
+	hdr->magic = SYSNOTI_V2_MAGIC;
+	hdr->version = SYSNOTI_V2_VERSION;
+	hdr->cmd = cmd;
+	hdr->pid = getpid();
+	hdr->nrec = 1;
+	rec->type_off = SYSNOTI_V2_NO_STR;
+	rec->path_off = SYSNOTI_V2_NO_STR;
+	if (type) {
+		len = strlen(type) + 1;
+		if (len > SYSNOTI_STATS_TYPE_LEN)
+			return -1;
+		memcpy(blob, type, len);
+		rec->type_off = 0;
+	}
+	hdr->blob_len = len;
+
+	return send(fd, frame, blob + len - frame, 0);
+}
+
+static int print_bg_lru(int fd)
+{
+	struct {
+		int32_t cnt;
+		struct sysnoti_bg_app apps[SYSNOTI_BG_LRU_MAX];
+	} reply;
+	ssize_t len;
+	int i;
+
+	if (query(fd, QUERY_SYSMAN_BG_LRU, NULL) < 0)
+		return -1;
+	len = recv(fd, &reply, sizeof(reply), 0);
+	if (len < (ssize_t)sizeof(reply.cnt) || reply.cnt < 0 ||
+	    (size_t)len != sizeof(reply.cnt) +
+	    (size_t)reply.cnt * sizeof(reply.apps[0]))
+		return -1;
+
+	printf("%-4s %-8s %-7s %-10s %s\n", "rank", "pid", "oom_adj",
+	       "idle(ms)", "rss(kB)");
+	for (i = 0; i < reply.cnt; i++)
+		printf("%-4d %-8d %-7d %-10u %u\n", i, reply.apps[i].pid,
+		       reply.apps[i].oomadj, reply.apps[i].idle_ms,
+		       reply.apps[i].rss_kb);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct sysnoti_action_stats st;
+	struct sockaddr_un addr;
+	const char *type = NULL;
+	int verbose = 0;
+	int lru = 0;
+	int32_t cnt;
+	ssize_t len;
+	char *buf;
+	int fd, i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-v"))
+			verbose = 1;
+		else if (!strcmp(argv[i], "-l"))
+			lru = 1;
+		else if (argv[i][0] != '-' && type == NULL)
+			type = argv[i];
+		else {
+			printf("[usage] sys_stats [-v] [action]\n");
+			printf("        sys_stats -l\n");
+			return -1;
+		}
+	}
+
+	fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, SYSNOTI_V2_SOCKET_PATH,
+		sizeof(addr.sun_path) - 1);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("connect");
+		close(fd);
+		return -1;
+	}
+
+	if (lru) {
+		i = print_bg_lru(fd);
+		if (i < 0)
+			printf("query failed\n");
+		close(fd);
+		return i;
+	}
+
+	/* one datagram, peek at its size first */
+	buf = NULL;
+	if (query(fd, QUERY_SYSMAN_STATS, type) < 0)
+		goto fail;
+	len = recv(fd, &cnt, sizeof(cnt), MSG_PEEK | MSG_TRUNC);
+	if (len < (ssize_t)sizeof(cnt))
+		goto fail;
+	buf = malloc(len);
+	if (buf == NULL || recv(fd, buf, len, 0) != len)
+		goto fail;
+	memcpy(&cnt, buf, sizeof(cnt));
+	if (cnt < 0 || (size_t)len != sizeof(cnt) + (size_t)cnt * sizeof(st))
+		goto fail;
+
+	for (i = 0; i < cnt; i++) {
+		memcpy(&st, buf + sizeof(cnt) + i * sizeof(st), sizeof(st));
+		st.type[SYSNOTI_STATS_TYPE_LEN - 1] = '\0';
+		print_stats(&st, verbose);
+	}
+
+	free(buf);
+	close(fd);
+	return 0;
+
+ fail:
+	printf("query failed\n");
+	free(buf);
+	close(fd);
+	return -1;
+}